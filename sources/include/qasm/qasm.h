@@ -3,24 +3,98 @@
 
 #include "cage-core/core.h"
 
+#include <vector>
+
 namespace qasm
 {
 	using namespace cage;
 
+	// sequence of instructions that are always executed one after another, jumps, calls and returns may only be at its end
+	struct ProgramBlock
+	{
+		uint32 firstInstruction = 0;
+		uint32 instructionsCount = 0;
+		uint32 function = m; // index into ProgramAnalysis::functions, m if the block is unreachable
+		uint32 immediateDominator = m; // index of block, m for entry blocks of functions and for unreachable blocks
+		uint32 loopHeader = m; // header block of the innermost loop containing this block, or m
+		uint32 loopDepth = 0; // number of loops containing this block
+		uint64 liveIn = 0; // registers whose current values may be read later (bits 0 - 25 are A - Z, bits 26 - 51 are a - z)
+		uint64 liveOut = 0;
+	};
+
+	struct ProgramFunction
+	{
+		uint32 entryBlock = 0;
+		uint32 functionIndex = 0; // see Program::functionName
+	};
+
+	struct ProgramCall
+	{
+		uint32 block = 0; // the block ending with the call instruction
+		uint32 caller = 0; // index into ProgramAnalysis::functions
+		uint32 callee = 0;
+	};
+
+	// control flow and register usage of a program
+	struct ProgramAnalysis : private Immovable
+	{
+		PointerRange<const ProgramBlock> blocks() const; // ordered by instructions
+		PointerRange<const ProgramFunction> functions() const; // the first function is the program entry, others are ordered by instructions
+		PointerRange<const ProgramCall> calls() const;
+		PointerRange<const uint32> successors(uint32 block) const; // control flow within the function, calls continue with the following block
+		PointerRange<const uint32> predecessors(uint32 block) const;
+		uint32 blockIndex(uint32 instruction) const;
+		bool dominates(uint32 dominator, uint32 block) const; // every path from the entry of the function to the block goes through the dominator
+		uint32 callDepth() const; // maximum number of nested calls, m if the program may recurse
+	};
+
 	struct Program : private Immovable
 	{
 		uint32 instructionsCount() const;
 		detail::StringBase<20> functionName(uint32 index) const;
 		PointerRange<const char> sourceCode() const;
-		string sourceCodeLine(uint32 index) const;
+		string sourceCodeLine(uint32 index) const; // uses index of lines built by the compiler, empty if the source code is not available
+		Holder<PointerRange<char>> exportBuffer(bool includeSourceCode = true) const; // serialized program, see newProgram
+		const ProgramAnalysis &analysis() const; // computed on first use and kept with the program, thread safe
+	};
+
+	constexpr uint32 ProgramFormatVersion = 6; // incremented whenever the layout of exported programs changes, see also CompilerVersion
+
+	Holder<Program> newProgram(PointerRange<const char> buffer); // loads previously exported program in place, without copying, the buffer must outlive the program
+
+	// functions compiled once, to be linked with programs
+	struct Module : private Immovable
+	{
+		Holder<PointerRange<char>> exportBuffer() const; // serialized module, see newModule
 	};
 
+	Holder<Module> newModule(PointerRange<const char> buffer); // loads previously exported module, the buffer is copied
+
 	struct Compiler : private Immovable
 	{
-		Holder<Program> compile(PointerRange<const char> sourceCode);
+		Holder<Program> compile(PointerRange<const char> sourceCode); // functions unchanged since the previous successful compilation with this compiler are reused, the result is the same as with a new compiler
+		Holder<Program> compile(PointerRange<const char> sourceCode, PointerRange<const Module *const> modules); // the functions of the modules are linked after the source code, the result is the same as if their source code was appended (including source lines and function names)
+		Holder<Module> compileModule(PointerRange<const char> sourceCode); // the source code may contain functions only, calls of functions from other modules or programs are resolved when linked
 	};
 
-	Holder<Compiler> newCompiler();
+	struct CompilerCreateConfig
+	{
+		// optimizations do not change behavior of the program, including the reported steps, source lines and function names
+		// (periodic interrupts may happen few steps later)
+		bool constantPropagation = false; // replaces registers with known values by immediate operands and folds constant computations
+		bool deadCodeElimination = false; // removes instructions and functions that can never be executed
+		bool jumpThreading = false; // redirects jumps to their final destination and moves code to avoid unconditional jumps, steps of the removed jumps are still counted
+		bool inlining = false; // replaces calls of small functions that do not call other functions by copies of their bodies; unlike the other optimizations, this changes the callstack and the stack overflow detection
+
+		bool keepSourceCode = true; // the program stores copy of the source code, for sourceCode and sourceCodeLine; disable to save memory
+		uint32 threads = 1; // functions are compiled in parallel on this many threads, m for one thread per processor; the program is the same, but errors in multiple functions may all be logged
+
+		std::vector<string> disabledInstructions; // same as in CpuLimitsConfig; uses of these instructions are reported as warnings and compiled as disabled
+	};
+
+	Holder<Compiler> newCompiler(const CompilerCreateConfig &config = {});
+
+	constexpr uint32 CompilerVersion = 1; // incremented whenever the compiler may generate different program for the same source code and config (eg. changes in code generation, optimizations or numbering of instructions)
 
 	enum class CpuStateEnum
 	{
@@ -70,6 +144,7 @@ namespace qasm
 		uint32 tapeCapacity = 1000000;
 		uint32 tapesCount = 4;
 		uint32 callstackCapacity = 1000;
+		std::vector<string> disabledInstructions; // names of instructions (eg. "fsqrt") or whole categories (eg. "arithmetic"), the program terminates when it reaches any of them
 	};
 
 	CpuLimitsConfig limitsFromIni(Ini *ini, const CpuLimitsConfig &defaults = {});
@@ -80,10 +155,27 @@ namespace qasm
 		CpuLimitsConfig limits;
 		Delegate<bool(string &)> input;
 		Delegate<bool(const string &)> output;
+		Delegate<uint32(PointerRange<uint32>)> binaryInput; // returns number of values actually read
+		Delegate<bool(PointerRange<const uint32>)> binaryOutput;
 		uint64 interruptPeriod = m; // the cpu is automatically interrupted every N-th step
 	};
 
 	Holder<Cpu> newCpu(const CpuCreateConfig &config);
+
+	// serves input from single buffer and collects all output into single buffer
+	struct MemoryIo : private Immovable
+	{
+		void input(PointerRange<const char> buffer); // the buffer must outlive the io
+		void expectedOutput(PointerRange<const char> buffer, Cpu *interruptOnMismatch = nullptr); // the buffer must outlive the io
+		void reset(); // rewinds the input and clears the output
+		void bind(CpuCreateConfig &config);
+
+		PointerRange<const char> output() const;
+		uint32 mismatchLine() const; // index of first written line that differs from the expected output, or m
+		bool outputMatches() const; // no mismatch and all expected lines were written
+	};
+
+	Holder<MemoryIo> newMemoryIo();
 }
 
 #endif // qasm_h_sd5f4ghsed4rg
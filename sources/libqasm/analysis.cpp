@@ -0,0 +1,604 @@
+#include <cage-core/math.h> // max
+
+#include "optimizer.h"
+#include "instructions.h"
+
+#include <algorithm> // sort, reverse
+
+namespace qasm
+{
+	namespace
+	{
+		// the instruction must be the last in its block
+		bool endsBlock(InstructionEnum instruction)
+		{
+			switch (instruction)
+			{
+			case InstructionEnum::jump:
+			case InstructionEnum::condjmp:
+			case InstructionEnum::call:
+			case InstructionEnum::condcall:
+			case InstructionEnum::return_:
+			case InstructionEnum::condreturn:
+			case InstructionEnum::exit:
+			case InstructionEnum::terminate:
+			case InstructionEnum::unreachable:
+			case InstructionEnum::disabled:
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		// the following instruction may be executed after this one, within the same function
+		bool fallsThrough(InstructionEnum instruction)
+		{
+			switch (instruction)
+			{
+			case InstructionEnum::jump:
+			case InstructionEnum::return_:
+			case InstructionEnum::exit:
+			case InstructionEnum::terminate:
+			case InstructionEnum::unreachable:
+			case InstructionEnum::disabled:
+				return false;
+			default:
+				return true;
+			}
+		}
+
+		bool isCall(InstructionEnum instruction)
+		{
+			return instruction == InstructionEnum::call || instruction == InstructionEnum::condcall;
+		}
+
+		bool isReturn(InstructionEnum instruction)
+		{
+			return instruction == InstructionEnum::return_ || instruction == InstructionEnum::condreturn;
+		}
+
+		constexpr uint64 AllRegisters = (uint64(1) << (26 + 26)) - 1;
+
+		// lists of neighbors of each node in one array
+		struct Adjacency
+		{
+			std::vector<uint32> offsets;
+			std::vector<uint32> data;
+
+			void build(uint32 nodes, const std::vector<std::pair<uint32, uint32>> &edges)
+			{
+				offsets.clear();
+				offsets.resize(nodes + 1, 0);
+				for (const auto &e : edges)
+					offsets[e.first + 1]++;
+				for (uint32 i = 0; i < nodes; i++)
+					offsets[i + 1] += offsets[i];
+				data.resize(edges.size());
+				std::vector<uint32> fill(offsets.begin(), offsets.end() - 1);
+				for (const auto &e : edges)
+					data[fill[e.first]++] = e.second;
+			}
+
+			PointerRange<const uint32> operator[](uint32 node) const
+			{
+				return { data.data() + offsets[node], data.data() + offsets[node + 1] };
+			}
+		};
+	}
+
+	struct ProgramAnalysisImpl : public ProgramAnalysis
+	{
+		std::vector<ProgramBlock> blocks;
+		std::vector<ProgramFunction> functions;
+		std::vector<ProgramCall> calls;
+		Adjacency successors, predecessors;
+		std::vector<uint32> blockOfInstruction;
+		uint32 callDepth = m;
+
+		ProgramAnalysisImpl(const ProgramSections &sections)
+		{
+			const OptimizerProgram program = optimizerDecode(sections);
+			findBlocks(program);
+			findEdges(program);
+			findFunctions(program);
+			findCallDepth(program);
+			findDominators();
+			findLoops();
+			findLiveness(program);
+		}
+
+		void findBlocks(const OptimizerProgram &program)
+		{
+			const uint32 count = numeric_cast<uint32>(program.size());
+			std::vector<bool> leader;
+			leader.resize(count + 1, false);
+			leader[0] = true;
+			for (uint32 i = 0; i < count; i++)
+			{
+				const OptimizerInstruction &ins = program[i];
+				if (endsBlock(ins.opcode))
+					leader[i + 1] = true;
+				const char *operands = instructionInfo(ins.opcode).operands;
+				for (uint32 j = 0; operands[j]; j++)
+					if (operands[j] == 'l')
+						leader[ins.operands[j]] = true;
+			}
+
+			blockOfInstruction.reserve(count);
+			for (uint32 i = 0; i < count; i++)
+			{
+				if (leader[i])
+				{
+					ProgramBlock b;
+					b.firstInstruction = i;
+					blocks.push_back(b);
+				}
+				blocks.back().instructionsCount++;
+				blockOfInstruction.push_back(numeric_cast<uint32>(blocks.size() - 1));
+			}
+		}
+
+		void findEdges(const OptimizerProgram &program)
+		{
+			const uint32 count = numeric_cast<uint32>(program.size());
+			std::vector<std::pair<uint32, uint32>> edges;
+			for (uint32 b = 0; b < blocks.size(); b++)
+			{
+				const uint32 last = blocks[b].firstInstruction + blocks[b].instructionsCount - 1;
+				const OptimizerInstruction &ins = program[last];
+				if (ins.opcode == InstructionEnum::jump || ins.opcode == InstructionEnum::condjmp)
+					edges.emplace_back(b, blockOfInstruction[ins.operands[0]]);
+				if (fallsThrough(ins.opcode) && last + 1 < count)
+				{
+					const uint32 next = blockOfInstruction[last + 1];
+					if (edges.empty() || edges.back() != std::pair<uint32, uint32>(b, next))
+						edges.emplace_back(b, next);
+				}
+			}
+			const uint32 blocksCount = numeric_cast<uint32>(blocks.size());
+			successors.build(blocksCount, edges);
+			for (auto &e : edges)
+				std::swap(e.first, e.second);
+			std::sort(edges.begin(), edges.end());
+			predecessors.build(blocksCount, edges);
+		}
+
+		void findFunctions(const OptimizerProgram &program)
+		{
+			std::vector<uint32> entries;
+			entries.push_back(0);
+			for (const OptimizerInstruction &ins : program)
+				if (isCall(ins.opcode))
+					entries.push_back(blockOfInstruction[ins.operands[0]]);
+			std::sort(entries.begin() + 1, entries.end());
+			entries.erase(std::unique(entries.begin() + 1, entries.end()), entries.end());
+			if (entries.size() > 1 && entries[1] == 0)
+				entries.erase(entries.begin() + 1); // the program entry is called recursively
+
+			// each block belongs to the first function that reaches it
+			std::vector<uint32> functionOfEntry;
+			functionOfEntry.resize(blocks.size(), m);
+			std::vector<uint32> worklist;
+			for (const uint32 entry : entries)
+			{
+				const uint32 f = numeric_cast<uint32>(functions.size());
+				functionOfEntry[entry] = f;
+				ProgramFunction fnc;
+				fnc.entryBlock = entry;
+				fnc.functionIndex = program[blocks[entry].firstInstruction].functionIndex;
+				functions.push_back(fnc);
+				if (blocks[entry].function != m)
+					continue;
+				blocks[entry].function = f;
+				worklist.push_back(entry);
+				while (!worklist.empty())
+				{
+					const uint32 b = worklist.back();
+					worklist.pop_back();
+					for (const uint32 s : successors[b])
+					{
+						if (blocks[s].function == m)
+						{
+							blocks[s].function = f;
+							worklist.push_back(s);
+						}
+					}
+				}
+			}
+
+			for (uint32 b = 0; b < blocks.size(); b++)
+			{
+				const OptimizerInstruction &ins = program[blocks[b].firstInstruction + blocks[b].instructionsCount - 1];
+				if (!isCall(ins.opcode) || blocks[b].function == m)
+					continue;
+				ProgramCall c;
+				c.block = b;
+				c.caller = blocks[b].function;
+				c.callee = functionOfEntry[blockOfInstruction[ins.operands[0]]];
+				calls.push_back(c);
+			}
+		}
+
+		// longest chain of calls starting in the program entry
+		// follows all code reachable from each function entry, not only the blocks assigned to the function
+		void findCallDepth(const OptimizerProgram &program)
+		{
+			const uint32 functionsCount = numeric_cast<uint32>(functions.size());
+			std::vector<uint32> functionOfEntry;
+			functionOfEntry.resize(blocks.size(), m);
+			for (uint32 f = 0; f < functionsCount; f++)
+				functionOfEntry[functions[f].entryBlock] = f;
+
+			std::vector<std::pair<uint32, uint32>> edges; // caller, callee
+			std::vector<uint32> visitedBy;
+			visitedBy.resize(blocks.size(), m);
+			std::vector<uint32> worklist;
+			for (uint32 f = 0; f < functionsCount; f++)
+			{
+				worklist.push_back(functions[f].entryBlock);
+				visitedBy[functions[f].entryBlock] = f;
+				while (!worklist.empty())
+				{
+					const uint32 b = worklist.back();
+					worklist.pop_back();
+					const OptimizerInstruction &ins = program[blocks[b].firstInstruction + blocks[b].instructionsCount - 1];
+					if (isCall(ins.opcode))
+						edges.emplace_back(f, functionOfEntry[blockOfInstruction[ins.operands[0]]]);
+					for (const uint32 s : successors[b])
+					{
+						if (visitedBy[s] != f)
+						{
+							visitedBy[s] = f;
+							worklist.push_back(s);
+						}
+					}
+				}
+			}
+			Adjacency callees;
+			callees.build(functionsCount, edges);
+
+			// depth first search in the call graph, reaching a function that is still in progress is a recursion
+			std::vector<uint32> depth;
+			depth.resize(functionsCount, m);
+			std::vector<bool> inProgress;
+			inProgress.resize(functionsCount, false);
+			std::vector<std::pair<uint32, uint32>> stack; // function, index of next callee
+			stack.emplace_back(0, 0);
+			inProgress[0] = true;
+			while (!stack.empty())
+			{
+				auto &top = stack.back();
+				const PointerRange<const uint32> next = callees[top.first];
+				if (top.second < next.size())
+				{
+					const uint32 c = next[top.second++];
+					if (inProgress[c])
+						return; // recursion
+					if (depth[c] == m)
+					{
+						inProgress[c] = true;
+						stack.emplace_back(c, 0);
+					}
+				}
+				else
+				{
+					uint32 d = 0;
+					for (const uint32 c : next)
+						d = max(d, depth[c] + 1);
+					depth[top.first] = d;
+					inProgress[top.first] = false;
+					stack.pop_back();
+				}
+			}
+			callDepth = depth[0];
+		}
+
+		// blocks of the function in reverse postorder
+		// visited is shared by all functions, since each block belongs to one function only
+		std::vector<uint32> reversePostorder(uint32 function, std::vector<bool> &visited) const
+		{
+			std::vector<uint32> order;
+			std::vector<std::pair<uint32, uint32>> stack; // block, index of next successor
+			const uint32 entry = functions[function].entryBlock;
+			if (blocks[entry].function != function)
+				return order;
+			stack.emplace_back(entry, 0);
+			visited[entry] = true;
+			while (!stack.empty())
+			{
+				auto &top = stack.back();
+				const PointerRange<const uint32> succ = successors[top.first];
+				if (top.second < succ.size())
+				{
+					const uint32 s = succ[top.second++];
+					if (!visited[s] && blocks[s].function == function)
+					{
+						visited[s] = true;
+						stack.emplace_back(s, 0);
+					}
+				}
+				else
+				{
+					order.push_back(top.first);
+					stack.pop_back();
+				}
+			}
+			std::reverse(order.begin(), order.end());
+			return order;
+		}
+
+		// iterative algorithm by Cooper, Harvey and Kennedy
+		void findDominators()
+		{
+			std::vector<uint32> rpoIndex;
+			rpoIndex.resize(blocks.size(), m);
+			std::vector<bool> visited;
+			visited.resize(blocks.size(), false);
+			for (uint32 f = 0; f < functions.size(); f++)
+			{
+				const std::vector<uint32> order = reversePostorder(f, visited);
+				if (order.empty())
+					continue;
+				for (uint32 i = 0; i < order.size(); i++)
+					rpoIndex[order[i]] = i;
+				const uint32 entry = order[0];
+				blocks[entry].immediateDominator = entry; // temporarily, for the intersections
+				const auto &intersect = [&](uint32 a, uint32 b) {
+					while (a != b)
+					{
+						while (rpoIndex[a] > rpoIndex[b])
+							a = blocks[a].immediateDominator;
+						while (rpoIndex[b] > rpoIndex[a])
+							b = blocks[b].immediateDominator;
+					}
+					return a;
+				};
+				bool changed = true;
+				while (changed)
+				{
+					changed = false;
+					for (uint32 i = 1; i < order.size(); i++)
+					{
+						const uint32 b = order[i];
+						uint32 idom = m;
+						for (const uint32 p : predecessors[b])
+						{
+							if (blocks[p].function != f || blocks[p].immediateDominator == m)
+								continue;
+							idom = idom == m ? p : intersect(p, idom);
+						}
+						if (idom != blocks[b].immediateDominator)
+						{
+							blocks[b].immediateDominator = idom;
+							changed = true;
+						}
+					}
+				}
+				blocks[entry].immediateDominator = m;
+			}
+		}
+
+		// natural loops, each back edge (to a dominating block) denotes a loop
+		void findLoops()
+		{
+			const uint32 blocksCount = numeric_cast<uint32>(blocks.size());
+			std::vector<uint32> loopSize; // of the innermost loop found so far for each block
+			loopSize.resize(blocksCount, m);
+			std::vector<bool> inLoop;
+			inLoop.resize(blocksCount, false);
+			std::vector<uint32> body;
+			std::vector<uint32> worklist;
+			for (uint32 header = 0; header < blocksCount; header++)
+			{
+				if (blocks[header].function == m)
+					continue;
+				body.clear();
+				body.push_back(header);
+				inLoop[header] = true;
+				for (const uint32 p : predecessors[header])
+				{
+					if (blocks[p].function != blocks[header].function || !dominates(header, p) || inLoop[p])
+						continue;
+					inLoop[p] = true;
+					body.push_back(p);
+					worklist.push_back(p);
+				}
+				if (body.size() == 1 && std::find(successors[header].begin(), successors[header].end(), header) == successors[header].end())
+				{
+					inLoop[header] = false;
+					continue; // no back edge
+				}
+				while (!worklist.empty())
+				{
+					const uint32 b = worklist.back();
+					worklist.pop_back();
+					for (const uint32 p : predecessors[b])
+					{
+						if (inLoop[p] || blocks[p].function != blocks[header].function)
+							continue;
+						inLoop[p] = true;
+						body.push_back(p);
+						worklist.push_back(p);
+					}
+				}
+				const uint32 size = numeric_cast<uint32>(body.size());
+				for (const uint32 b : body)
+				{
+					inLoop[b] = false;
+					blocks[b].loopDepth++;
+					if (size < loopSize[b])
+					{
+						loopSize[b] = size;
+						blocks[b].loopHeader = header;
+					}
+				}
+			}
+		}
+
+		// liveness is computed over the whole program, calls continue in the called function and returns continue after every call of the function
+		void findLiveness(const OptimizerProgram &program)
+		{
+			const uint32 blocksCount = numeric_cast<uint32>(blocks.size());
+			std::vector<uint64> uses, defs;
+			uses.resize(blocksCount, 0);
+			defs.resize(blocksCount, 0);
+			for (uint32 b = 0; b < blocksCount; b++)
+			{
+				uint64 use = 0, def = 0;
+				for (uint32 i = blocks[b].firstInstruction; i < blocks[b].firstInstruction + blocks[b].instructionsCount; i++)
+				{
+					const OptimizerInstruction &ins = program[i];
+					const InstructionInfo info = instructionInfo(ins.opcode);
+					uint64 reads = info.implicitReads, writes = info.implicitWrites;
+					for (uint32 j = 0; info.operands[j]; j++)
+					{
+						const uint64 bit = uint64(1) << ins.operands[j];
+						switch (info.operands[j])
+						{
+						case 'r': reads |= bit; break;
+						case 'x': reads |= bit; writes |= bit; break;
+						case 'd': writes |= bit; break;
+						}
+					}
+					if (info.writesAnyRegister)
+						reads = AllRegisters; // the source register is chosen at runtime
+					use |= reads & ~def;
+					def |= writes;
+				}
+				uses[b] = use;
+				defs[b] = def;
+			}
+
+			std::vector<std::pair<uint32, uint32>> edges;
+			for (const ProgramCall &c : calls)
+				if (c.block + 1 < blocksCount)
+					edges.emplace_back(c.callee, c.block + 1);
+			std::sort(edges.begin(), edges.end());
+			Adjacency continuations; // for each function, blocks following its calls
+			continuations.build(numeric_cast<uint32>(functions.size()), edges);
+			edges.clear();
+
+			for (uint32 b = 0; b < blocksCount; b++)
+			{
+				const InstructionEnum last = program[blocks[b].firstInstruction + blocks[b].instructionsCount - 1].opcode;
+				if (isReturn(last) && blocks[b].function != m)
+				{
+					for (const uint32 s : continuations[blocks[b].function])
+						edges.emplace_back(b, s);
+				}
+				if (last == InstructionEnum::call)
+					continue; // continues in the called function
+				for (const uint32 s : successors[b])
+					edges.emplace_back(b, s);
+			}
+			for (const ProgramCall &c : calls)
+				edges.emplace_back(c.block, functions[c.callee].entryBlock);
+			std::sort(edges.begin(), edges.end());
+			edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+			Adjacency flow;
+			flow.build(blocksCount, edges);
+			for (auto &e : edges)
+				std::swap(e.first, e.second);
+			std::sort(edges.begin(), edges.end());
+			Adjacency reverse;
+			reverse.build(blocksCount, edges);
+
+			std::vector<uint32> worklist;
+			std::vector<bool> queued;
+			queued.resize(blocksCount, true);
+			worklist.reserve(blocksCount);
+			for (uint32 b = 0; b < blocksCount; b++)
+				worklist.push_back(b); // the last block is processed first
+			while (!worklist.empty())
+			{
+				const uint32 b = worklist.back();
+				worklist.pop_back();
+				queued[b] = false;
+				ProgramBlock &block = blocks[b];
+				for (const uint32 s : flow[b])
+					block.liveOut |= blocks[s].liveIn;
+				const uint64 in = uses[b] | (block.liveOut & ~defs[b]);
+				if (in == block.liveIn)
+					continue;
+				block.liveIn = in;
+				for (const uint32 p : reverse[b])
+				{
+					if (!queued[p])
+					{
+						queued[p] = true;
+						worklist.push_back(p);
+					}
+				}
+			}
+		}
+
+		bool dominates(uint32 dominator, uint32 block) const
+		{
+			while (block != m)
+			{
+				if (block == dominator)
+					return true;
+				block = blocks[block].immediateDominator;
+			}
+			return false;
+		}
+	};
+
+	Holder<ProgramAnalysis> programAnalyze(const ProgramSections &sections)
+	{
+		return detail::systemArena().createImpl<ProgramAnalysis, ProgramAnalysisImpl>(sections);
+	}
+
+	PointerRange<const ProgramBlock> ProgramAnalysis::blocks() const
+	{
+		const ProgramAnalysisImpl *impl = (const ProgramAnalysisImpl *)this;
+		return impl->blocks;
+	}
+
+	PointerRange<const ProgramFunction> ProgramAnalysis::functions() const
+	{
+		const ProgramAnalysisImpl *impl = (const ProgramAnalysisImpl *)this;
+		return impl->functions;
+	}
+
+	PointerRange<const ProgramCall> ProgramAnalysis::calls() const
+	{
+		const ProgramAnalysisImpl *impl = (const ProgramAnalysisImpl *)this;
+		return impl->calls;
+	}
+
+	PointerRange<const uint32> ProgramAnalysis::successors(uint32 block) const
+	{
+		const ProgramAnalysisImpl *impl = (const ProgramAnalysisImpl *)this;
+		CAGE_ASSERT(block < impl->blocks.size());
+		return impl->successors[block];
+	}
+
+	PointerRange<const uint32> ProgramAnalysis::predecessors(uint32 block) const
+	{
+		const ProgramAnalysisImpl *impl = (const ProgramAnalysisImpl *)this;
+		CAGE_ASSERT(block < impl->blocks.size());
+		return impl->predecessors[block];
+	}
+
+	uint32 ProgramAnalysis::blockIndex(uint32 instruction) const
+	{
+		const ProgramAnalysisImpl *impl = (const ProgramAnalysisImpl *)this;
+		if (instruction >= impl->blockOfInstruction.size())
+			CAGE_THROW_ERROR(Exception, "program instruction index out of range");
+		return impl->blockOfInstruction[instruction];
+	}
+
+	bool ProgramAnalysis::dominates(uint32 dominator, uint32 block) const
+	{
+		const ProgramAnalysisImpl *impl = (const ProgramAnalysisImpl *)this;
+		CAGE_ASSERT(dominator < impl->blocks.size() && block < impl->blocks.size());
+		return impl->dominates(dominator, block);
+	}
+
+	uint32 ProgramAnalysis::callDepth() const
+	{
+		const ProgramAnalysisImpl *impl = (const ProgramAnalysisImpl *)this;
+		return impl->callDepth;
+	}
+}
@@ -0,0 +1,120 @@
+#include "characters.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define QASM_CHARACTERS_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace qasm
+{
+	namespace
+	{
+		constexpr bool inRange(uint32 c, char a, char b)
+		{
+			return c >= uint32(a) && c <= uint32(b);
+		}
+
+		constexpr bool isCode(uint32 c)
+		{
+			// the ranges must match the simd implementation below
+			return inRange(c, '0', '9') || inRange(c, '@', 'Z') || inRange(c, 'a', 'z') || c == ' ' || c == '#' || c == '+' || c == '-' || c == '.' || c == '_';
+		}
+
+		constexpr bool isText(uint32 c)
+		{
+			// the ranges must match the simd implementation below
+			return inRange(c, '(', 'Z') || inRange(c, 'a', 'z') || c == ' ' || c == '!' || c == '#' || c == '_';
+		}
+
+		struct CharacterTable
+		{
+			uint8 flags[256] = {};
+
+			constexpr CharacterTable()
+			{
+				for (uint32 c = 0; c < 256; c++)
+					flags[c] = (isCode(c) ? uint8(CharacterClassEnum::Code) : 0) | (isText(c) ? uint8(CharacterClassEnum::Text) : 0);
+			}
+		};
+
+		constexpr CharacterTable table;
+
+		static_assert(isText('*') && isText('/') && isText(',') && isText('<') && isText('?') && isText(':') && isText(';') && isText('@'));
+		static_assert(!isCode('*') && !isCode('/') && !isCode(',') && !isCode('<') && !isCode('?') && !isCode(':') && !isCode(';') && isCode('@'));
+		static_assert(!isText('\t') && !isText('"') && !isText('$') && !isText('[') && !isText('`') && !isText('{') && !isText(127));
+
+#ifdef QASM_CHARACTERS_SSE2
+		__m128i simdRange(__m128i v, char a, char b)
+		{
+			// bytes above 127 are negative and fail the comparison
+			return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(a - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8(b + 1)));
+		}
+
+		__m128i simdEqual(__m128i v, char a)
+		{
+			return _mm_cmpeq_epi8(v, _mm_set1_epi8(a));
+		}
+
+		__m128i simdValid(__m128i v, CharacterClassEnum cls)
+		{
+			if (cls == CharacterClassEnum::Code)
+			{
+				__m128i r = _mm_or_si128(simdRange(v, '0', '9'), simdRange(v, '@', 'Z'));
+				r = _mm_or_si128(r, simdRange(v, 'a', 'z'));
+				r = _mm_or_si128(r, _mm_or_si128(simdEqual(v, ' '), simdEqual(v, '#')));
+				r = _mm_or_si128(r, _mm_or_si128(simdEqual(v, '+'), simdEqual(v, '-')));
+				r = _mm_or_si128(r, _mm_or_si128(simdEqual(v, '.'), simdEqual(v, '_')));
+				return r;
+			}
+			else
+			{
+				__m128i r = _mm_or_si128(simdRange(v, '(', 'Z'), simdRange(v, 'a', 'z'));
+				r = _mm_or_si128(r, _mm_or_si128(simdEqual(v, ' '), simdEqual(v, '!')));
+				r = _mm_or_si128(r, _mm_or_si128(simdEqual(v, '#'), simdEqual(v, '_')));
+				return r;
+			}
+		}
+#endif // QASM_CHARACTERS_SSE2
+	}
+
+	uint32 findInvalidCharacter(PointerRange<const char> str, CharacterClassEnum cls)
+	{
+		const uint8 flag = uint8(cls);
+		const uint32 size = numeric_cast<uint32>(str.size());
+		uint32 pos = 0;
+#ifdef QASM_CHARACTERS_SSE2
+		for (; pos + 16 <= size; pos += 16)
+		{
+			const __m128i v = _mm_loadu_si128((const __m128i *)(str.data() + pos));
+			if (_mm_movemask_epi8(simdValid(v, cls)) != 0xFFFF)
+				break; // the scalar loop will find the exact position
+		}
+#endif // QASM_CHARACTERS_SSE2
+		for (; pos < size; pos++)
+			if ((table.flags[uint8(str[pos])] & flag) == 0)
+				return pos;
+		return m;
+	}
+
+	bool isValidCharacter(uint32 c, CharacterClassEnum cls)
+	{
+		return c < 256 && (table.flags[c] & uint8(cls)) != 0;
+	}
+
+	string filterCharacters(const string &str)
+	{
+		uint32 pos = findInvalidCharacter(str, CharacterClassEnum::Text);
+		if (pos == m)
+			return str;
+		char buffer[string::MaxLength];
+		detail::memcpy(buffer, str.data(), pos);
+		uint32 len = pos;
+		for (; pos < str.length(); pos++)
+		{
+			const char c = str[pos];
+			if (table.flags[uint8(c)] & uint8(CharacterClassEnum::Text))
+				buffer[len++] = c;
+		}
+		return string(PointerRange<const char>(buffer, buffer + len));
+	}
+}
@@ -0,0 +1,23 @@
+#ifndef characters_h_f4g5s6ed4
+#define characters_h_f4g5s6ed4
+
+#include <qasm/qasm.h>
+
+namespace qasm
+{
+	enum class CharacterClassEnum : uint8
+	{
+		Code = 1 << 0, // characters allowed in source code outside comments
+		Text = 1 << 1, // characters allowed in comments and in input/output
+	};
+
+	// index of first character not belonging to the class, or m if all characters are valid
+	uint32 findInvalidCharacter(PointerRange<const char> str, CharacterClassEnum cls);
+
+	bool isValidCharacter(uint32 c, CharacterClassEnum cls);
+
+	// removes all characters that are not valid for input/output
+	string filterCharacters(const string &str);
+}
+
+#endif // characters_h_f4g5s6ed4
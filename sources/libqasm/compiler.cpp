@@ -4,17 +4,37 @@
 #include <cage-core/serialization.h>
 #include <cage-core/memoryBuffer.h>
 #include <cage-core/macros.h>
+#include <cage-core/math.h> // min
+#include <cage-core/concurrent.h>
 
 #include "program.h"
+#include "characters.h"
+#include "optimizer.h"
+#include "instructions.h"
 
-#include <map>
+#include <unordered_map>
 #include <vector>
+#include <atomic>
+#include <exception>
 
 namespace qasm
 {
 	namespace
 	{
 		using Name = detail::StringBase<20>;
+		using Token = PointerRange<const char>;
+
+		constexpr uint32 hashChars(const char *str, uintPtr length, uint32 seed = 2166136261u)
+		{
+			// fnv-1a
+			uint32 h = seed;
+			for (uintPtr i = 0; i < length; i++)
+			{
+				h ^= uint8(str[i]);
+				h *= 16777619u;
+			}
+			return h;
+		}
 
 		struct Label
 		{
@@ -22,76 +42,82 @@ namespace qasm
 			Name label;
 		};
 
-		bool operator < (const Label &l, const Label &r)
+		bool operator == (const Label &l, const Label &r)
 		{
-			if (l.function == r.function)
-				return l.label < r.label;
-			return l.function < r.function;
+			return l.function == r.function && l.label == r.label;
 		}
 
+		struct LabelHash
+		{
+			uintPtr operator () (const Label &l) const
+			{
+				return hashChars(l.label.data(), l.label.length(), hashChars(l.function.data(), l.function.length()));
+			}
+		};
+
+		struct NameHash
+		{
+			uintPtr operator () (const Name &n) const
+			{
+				return hashChars(n.data(), n.length());
+			}
+		};
+
 		struct LabelReplacement : public Label
 		{
 			uint32 paramsOffset = m;
 			uint32 sourceLine = m; // for error reporting
+			bool call = false;
 		};
 
-		string decomment(const string &line)
+		// splits the line into space separated tokens, without copying
+		struct Tokenizer
 		{
-			const uint32 commentStart = find(line, "#");
-			for (uint32 pos = 0; pos < line.length(); pos++)
+			Token line;
+
+			Token next()
 			{
-				const char c = line[pos];
-				if (c >= 'a' && c <= 'z')
-					continue;
-				if (c >= 'A' && c <= 'Z')
-					continue;
-				if (c >= '0' && c <= '9')
-					continue;
-				switch (c)
-				{
-				case ' ':
-				case '-':
-				case '+':
-				case '.':
-				case '_':
-				case '@':
-				case '#':
-					continue;
-				}
-				if (pos >= commentStart)
-				{
-					switch (c)
-					{
-					case '*':
-					case '/':
-					case ',':
-					case '(':
-					case ')':
-					case '<':
-					case '>':
-					case '=':
-					case '?':
-					case '!':
-					case ':':
-					case ';':
-						continue;
-					}
-				}
-				CAGE_THROW_ERROR(Exception, "invalid character");
+				const char *p = line.begin();
+				while (p < line.end() && *p != ' ')
+					p++;
+				const Token t = { line.begin(), p };
+				while (p < line.end() && *p == ' ')
+					p++;
+				line = { p, line.end() };
+				return t;
+			}
+
+			bool empty() const
+			{
+				return line.empty();
 			}
-			string s = trim(subString(line, 0, commentStart));
-			s = replace(s, "\t", " ");
-			s = replace(s, "  ", " ");
-			return s;
+		};
+
+		// returns the code part of the line, without the comment and surrounding spaces
+		Token decomment(Token line)
+		{
+			const char *commentStart = line.begin();
+			while (commentStart < line.end() && *commentStart != '#')
+				commentStart++;
+			if (findInvalidCharacter({ line.begin(), commentStart }, CharacterClassEnum::Code) != m)
+				CAGE_THROW_ERROR(Exception, "invalid character");
+			if (findInvalidCharacter({ commentStart, line.end() }, CharacterClassEnum::Text) != m)
+				CAGE_THROW_ERROR(Exception, "invalid character");
+			const char *b = line.begin();
+			const char *e = commentStart;
+			while (b < e && *b == ' ')
+				b++;
+			while (e > b && e[-1] == ' ')
+				e--;
+			return { b, e };
 		}
 
-		void validateName(const string &name)
+		void validateName(Token name)
 		{
-			if (name.length() < 3 || name.length() > 20)
+			if (name.size() < 3 || name.size() > 20)
 				CAGE_THROW_ERROR(Exception, "function/label name has invalid length");
-			for (uint32 pos = 0; pos < name.length(); pos++)
+			for (const char c : name)
 			{
-				const char c = name[pos];
 				if (c >= 'a' && c <= 'z')
 					continue;
 				if (c >= 'A' && c <= 'Z')
@@ -104,12 +130,27 @@ namespace qasm
 				CAGE_THROW_ERROR(Exception, "function/label name must start with capital letter");
 		}
 
-		uint8 getRegister(string &line)
+		uint32 toUint32(Token t)
+		{
+			return cage::toUint32(string(t));
+		}
+
+		sint32 toSint32(Token t)
+		{
+			return cage::toSint32(string(t));
+		}
+
+		float toFloat(Token t)
+		{
+			return cage::toFloat(string(t));
+		}
+
+		uint8 getRegister(Tokenizer &line)
 		{
-			string n = split(line);
+			const Token n = line.next();
 			if (n.empty())
 				CAGE_THROW_ERROR(Exception, "missing register name parameter");
-			if (n.length() != 1)
+			if (n.size() != 1)
 				CAGE_THROW_ERROR(Exception, "register name too long");
 			if (n[0] >= 'A' && n[0] <= 'Z')
 				return n[0] - 'A';
@@ -118,19 +159,22 @@ namespace qasm
 			CAGE_THROW_ERROR(Exception, "invalid character in register name");
 		}
 
-		void getStructure(string &line, uint8 &type, uint8 &index, uint32 &address)
+		void getStructure(Tokenizer &line, uint8 &type, uint8 &index, uint32 &address)
 		{
-			string a = split(line);
-			string n = split(a, "@");
-			if (a.empty())
+			const Token a = line.next();
+			const char *at = a.begin();
+			while (at < a.end() && *at != '@')
+				at++;
+			const Token n = { a.begin(), at };
+			if (at + 1 >= a.end())
 				address = 0;
 			else
-				address = toUint32(a);
+				address = toUint32(Token(at + 1, a.end()));
 			if (n.empty())
 				CAGE_THROW_ERROR(Exception, "missing structure name parameter");
-			if (n.length() < 2)
+			if (n.size() < 2)
 				CAGE_THROW_ERROR(Exception, "structure name too short");
-			if (n.length() > 2)
+			if (n.size() > 2)
 				CAGE_THROW_ERROR(Exception, "structure name too long");
 			if (n[1] < 'A' || n[1] > 'Z')
 				CAGE_THROW_ERROR(Exception, "invalid character in structure instance name");
@@ -146,7 +190,7 @@ namespace qasm
 			}
 		}
 
-		void getStructure(string &line, uint8 &type, uint8 &index)
+		void getStructure(Tokenizer &line, uint8 &type, uint8 &index)
 		{
 			uint32 address;
 			getStructure(line, type, index, address);
@@ -154,537 +198,1215 @@ namespace qasm
 				CAGE_THROW_ERROR(Exception, "address specifier is forbidden here");
 		}
 
-		struct DataState
+		enum class SyntaxEnum : uint8
 		{
-			PointerRangeHolder<InstructionEnum> instructions;
-			PointerRangeHolder<uint32> paramsOffsets;
-			PointerRangeHolder<uint32> sourceLines;
-			PointerRangeHolder<uint32> functionIndices;
-			MemoryBuffer paramsBuffer;
-			Serializer params = Serializer(paramsBuffer);
-
-			std::vector<LabelReplacement> labelsReplacements; // which positions in parameters should be updated to what position of label in a function
-			std::map<Label, uint32> labelNameToInstruction;
-			std::map<Name, uint32> functionNameToIndex;
-			PointerRangeHolder<Name> functionIndexToName;
-			uint32 currentFunctionIndex = 0;
-			uint32 currentSourceLine = 0;
+			Registers, // fixed number of register operands
+			RegisterUint,
+			RegisterSint,
+			RegisterFloat,
+			Load,
+			Store,
+			IndLoad,
+			IndStore,
+			Pop,
+			Push,
+			Dequeue,
+			Enqueue,
+			Left,
+			Right,
+			Center,
+			Swap,
+			IndSwap,
+			Stat,
+			IndStat,
+			Label,
+			Jump,
+			Function,
+			Call,
+			Return,
+			BulkRead,
+			BulkWrite,
+			Binary,
+			DataUint,
+			DataSint,
+			DataFloat,
 		};
-	}
 
-	struct CompilerImpl : public Compiler, public DataState
-	{
-		void insert(InstructionEnum instruction)
+		struct Mnemonic
 		{
-			instructions.push_back(instruction);
-			paramsOffsets.push_back(numeric_cast<uint32>(paramsBuffer.size()));
-			sourceLines.push_back(currentSourceLine);
-			functionIndices.push_back(currentFunctionIndex);
-		}
+			const char *name = nullptr;
+			uint32 length = 0;
+			InstructionEnum opcode = InstructionEnum::nop;
+			InstructionEnum alternative = InstructionEnum::nop; // memory pool variant of binary input/output
+			SyntaxEnum syntax = SyntaxEnum::Registers;
+			uint8 registers = 0;
+
+			constexpr Mnemonic(const char *name, SyntaxEnum syntax, InstructionEnum opcode, uint8 registers = 0, InstructionEnum alternative = InstructionEnum::nop) : name(name), opcode(opcode), alternative(alternative), syntax(syntax), registers(registers)
+			{
+				while (name[length])
+					length++;
+			}
+		};
+
+#define SimpleMnemonic_0(Name) Mnemonic(CAGE_STRINGIZE(Name), SyntaxEnum::Registers, InstructionEnum::Name, 0),
+#define SimpleMnemonic_1(Name) Mnemonic(CAGE_STRINGIZE(Name), SyntaxEnum::Registers, InstructionEnum::Name, 1),
+#define SimpleMnemonic_2(Name) Mnemonic(CAGE_STRINGIZE(Name), SyntaxEnum::Registers, InstructionEnum::Name, 2),
+#define SimpleMnemonic_3(Name) Mnemonic(CAGE_STRINGIZE(Name), SyntaxEnum::Registers, InstructionEnum::Name, 3),
+
+		constexpr const Mnemonic Mnemonics[] = {
+			// registers
+			CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(SimpleMnemonic_0, indcpy))
+			CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(SimpleMnemonic_1, reset, condrst))
+			CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(SimpleMnemonic_2, copy, condcpy))
+			Mnemonic("set", SyntaxEnum::RegisterUint, InstructionEnum::set),
+			Mnemonic("iset", SyntaxEnum::RegisterSint, InstructionEnum::iset),
+			Mnemonic("fset", SyntaxEnum::RegisterFloat, InstructionEnum::fset),
+			Mnemonic("condset", SyntaxEnum::RegisterUint, InstructionEnum::condset),
+			Mnemonic("condiset", SyntaxEnum::RegisterSint, InstructionEnum::condiset),
+			Mnemonic("condfset", SyntaxEnum::RegisterFloat, InstructionEnum::condfset),
+
+			// arithmetics
+			CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(SimpleMnemonic_1, inc, dec, iinc, idec))
+			CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(SimpleMnemonic_2, iabs, fabs, fsqrt, flog, fsin, fcos, ftan, fasin, facos, fatan, ffloor, fround, fceil, s2f, u2f, f2s, f2u))
+			CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(SimpleMnemonic_3, add, sub, mul, div, mod, iadd, isub, imul, idiv, imod, fadd, fsub, fmul, fdiv, fpow, fatan2))
+
+			// logic
+			CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(SimpleMnemonic_1, inv, binv))
+			CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(SimpleMnemonic_3, shl, shr, rol, ror, band, bor, bxor))
+			Mnemonic("not", SyntaxEnum::Registers, InstructionEnum::not_, 2),
+			Mnemonic("bnot", SyntaxEnum::Registers, InstructionEnum::bnot, 2),
+			Mnemonic("and", SyntaxEnum::Registers, InstructionEnum::and_, 3),
+			Mnemonic("or", SyntaxEnum::Registers, InstructionEnum::or_, 3),
+			Mnemonic("xor", SyntaxEnum::Registers, InstructionEnum::xor_, 3),
 
-		void scopeExit()
+			// comparisons
+			CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(SimpleMnemonic_2, fisnan, fisinf, fisfin, fisnorm, test))
+			CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(SimpleMnemonic_3, eq, neq, lt, gt, lte, gte, ieq, ineq, ilt, igt, ilte, igte, feq, fneq, flt, fgt, flte, fgte))
+
+			// structures
+			Mnemonic("load", SyntaxEnum::Load, InstructionEnum::nop),
+			Mnemonic("store", SyntaxEnum::Store, InstructionEnum::nop),
+			Mnemonic("indload", SyntaxEnum::IndLoad, InstructionEnum::indload),
+			Mnemonic("indstore", SyntaxEnum::IndStore, InstructionEnum::indstore),
+			CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(SimpleMnemonic_1, indindload, indindstore))
+			Mnemonic("data", SyntaxEnum::DataUint, InstructionEnum::nop),
+			Mnemonic("idata", SyntaxEnum::DataSint, InstructionEnum::nop),
+			Mnemonic("fdata", SyntaxEnum::DataFloat, InstructionEnum::nop),
+			Mnemonic("pop", SyntaxEnum::Pop, InstructionEnum::pop),
+			Mnemonic("push", SyntaxEnum::Push, InstructionEnum::push),
+			Mnemonic("dequeue", SyntaxEnum::Dequeue, InstructionEnum::dequeue),
+			Mnemonic("enqueue", SyntaxEnum::Enqueue, InstructionEnum::enqueue),
+			Mnemonic("left", SyntaxEnum::Left, InstructionEnum::left),
+			Mnemonic("right", SyntaxEnum::Right, InstructionEnum::right),
+			Mnemonic("center", SyntaxEnum::Center, InstructionEnum::center),
+			Mnemonic("swap", SyntaxEnum::Swap, InstructionEnum::nop),
+			Mnemonic("indswap", SyntaxEnum::IndSwap, InstructionEnum::nop),
+			Mnemonic("stat", SyntaxEnum::Stat, InstructionEnum::nop),
+			Mnemonic("indstat", SyntaxEnum::IndStat, InstructionEnum::nop),
+
+			// jumps
+			Mnemonic("label", SyntaxEnum::Label, InstructionEnum::nop),
+			Mnemonic("jump", SyntaxEnum::Jump, InstructionEnum::jump),
+			Mnemonic("condjmp", SyntaxEnum::Jump, InstructionEnum::condjmp),
+
+			// functions
+			Mnemonic("function", SyntaxEnum::Function, InstructionEnum::nop),
+			Mnemonic("call", SyntaxEnum::Call, InstructionEnum::call),
+			Mnemonic("condcall", SyntaxEnum::Call, InstructionEnum::condcall),
+			Mnemonic("return", SyntaxEnum::Return, InstructionEnum::return_),
+			Mnemonic("condreturn", SyntaxEnum::Return, InstructionEnum::condreturn),
+
+			// input/output
+			CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(SimpleMnemonic_0, rstat, wstat, readln, rreset, rclear, writeln, wreset, wclear, rwswap))
+			CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(SimpleMnemonic_1, read, iread, fread, cread, write, iwrite, fwrite, cwrite))
+			Mnemonic("readall", SyntaxEnum::BulkRead, InstructionEnum::readall),
+			Mnemonic("ireadall", SyntaxEnum::BulkRead, InstructionEnum::ireadall),
+			Mnemonic("freadall", SyntaxEnum::BulkRead, InstructionEnum::freadall),
+			Mnemonic("readlns", SyntaxEnum::BulkRead, InstructionEnum::readlns),
+			Mnemonic("ireadlns", SyntaxEnum::BulkRead, InstructionEnum::ireadlns),
+			Mnemonic("freadlns", SyntaxEnum::BulkRead, InstructionEnum::freadlns),
+			Mnemonic("writeall", SyntaxEnum::BulkWrite, InstructionEnum::writeall),
+			Mnemonic("iwriteall", SyntaxEnum::BulkWrite, InstructionEnum::iwriteall),
+			Mnemonic("fwriteall", SyntaxEnum::BulkWrite, InstructionEnum::fwriteall),
+			Mnemonic("bread", SyntaxEnum::Binary, InstructionEnum::bread, 0, InstructionEnum::bmread),
+			Mnemonic("bwrite", SyntaxEnum::Binary, InstructionEnum::bwrite, 0, InstructionEnum::bmwrite),
+
+			// random
+			CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(SimpleMnemonic_1, rand, irand, frand))
+
+			// miscellaneous
+			CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(SimpleMnemonic_0, breakpoint, terminate))
+		};
+
+#undef SimpleMnemonic_0
+#undef SimpleMnemonic_1
+#undef SimpleMnemonic_2
+#undef SimpleMnemonic_3
+
+		constexpr uint32 MnemonicsCount = sizeof(Mnemonics) / sizeof(Mnemonics[0]);
+		constexpr uint32 MnemonicsSlots = 2048; // power of two
+		constexpr uint32 MnemonicsSeed = 56; // found by search such that all mnemonics land in distinct slots
+		static_assert(MnemonicsCount < 255);
+
+		constexpr uint32 mnemonicSlot(const char *str, uintPtr length)
 		{
-			// leaving function without return terminates the program
-			// leaving program scope is successful exit
-			insert(currentFunctionIndex == 0 ? InstructionEnum::exit : InstructionEnum::unreachable);
-			// better function name detection
-			insert(InstructionEnum::nop);
+			return hashChars(str, length, MnemonicsSeed) & (MnemonicsSlots - 1);
 		}
 
-		void processLabel(string &line)
+		struct MnemonicsTable
 		{
-			validateName(line);
-			Label label;
-			label.label = split(line);
-			label.function = functionIndexToName.at(currentFunctionIndex);
-			if (labelNameToInstruction.count(label))
-				CAGE_THROW_ERROR(Exception, "label name is not unique");
-			labelNameToInstruction[label] = numeric_cast<uint32>(instructions.size());
-		}
+			uint8 slots[MnemonicsSlots] = {}; // index into Mnemonics plus one, zero is empty
+			bool perfect = true;
 
-		void processJump(string &line, bool condition)
-		{
-			validateName(line);
-			LabelReplacement label;
-			label.label = split(line);
-			label.function = functionIndexToName.at(currentFunctionIndex);
-			insert(condition ? InstructionEnum::condjmp : InstructionEnum::jump);
-			label.paramsOffset = numeric_cast<uint32>(paramsBuffer.size());
-			label.sourceLine = currentSourceLine;
-			labelsReplacements.push_back(label);
-			params << uint32(m); // this value will be replaced by address of the label after parsing the source code has finished
-		}
+			constexpr MnemonicsTable()
+			{
+				for (uint32 i = 0; i < MnemonicsCount; i++)
+				{
+					const uint32 s = mnemonicSlot(Mnemonics[i].name, Mnemonics[i].length);
+					if (slots[s] != 0)
+						perfect = false;
+					slots[s] = i + 1;
+				}
+			}
+		};
 
-		void processFunction(string &line)
-		{
-			scopeExit();
-			validateName(line);
-			Label label;
-			label.label = label.function = split(line);
-			if (labelNameToInstruction.count(label))
-				CAGE_THROW_ERROR(Exception, "function name is not unique");
-			labelNameToInstruction[label] = numeric_cast<uint32>(instructions.size());
-			currentFunctionIndex++;
-			functionNameToIndex[label.function] = currentFunctionIndex;
-			functionIndexToName.push_back(label.function);
-		}
+		constexpr MnemonicsTable mnemonicsTable;
+		static_assert(mnemonicsTable.perfect, "mnemonics hash collision, update MnemonicsSeed");
 
-		void processCall(string &line, bool condition)
+		const Mnemonic *findMnemonic(Token name)
 		{
-			validateName(line);
-			LabelReplacement label;
-			label.label = label.function = split(line);
-			insert(condition ? InstructionEnum::condcall : InstructionEnum::call);
-			label.paramsOffset = numeric_cast<uint32>(paramsBuffer.size());
-			label.sourceLine = currentSourceLine;
-			labelsReplacements.push_back(label);
-			params << uint32(m); // this value will be replaced by address of the label after parsing the source code has finished
+			const uint8 slot = mnemonicsTable.slots[mnemonicSlot(name.data(), name.size())];
+			if (slot == 0)
+				return nullptr;
+			const Mnemonic &mn = Mnemonics[slot - 1];
+			if (mn.length != name.size() || detail::memcmp(mn.name, name.data(), mn.length) != 0)
+				return nullptr;
+			return &mn;
 		}
 
-		void processReturn(string &line, bool condition)
+		// whether the line starts a new function, the line is fully validated later when it is compiled
+		bool isFunctionDeclaration(Token line)
 		{
-			insert(condition ? InstructionEnum::condreturn : InstructionEnum::return_);
+			constexpr const char keyword[] = "function";
+			constexpr uintPtr length = sizeof(keyword) - 1;
+			const char *p = line.begin();
+			while (p < line.end() && *p == ' ')
+				p++;
+			if (uintPtr(line.end() - p) < length || detail::memcmp(p, keyword, length) != 0)
+				return false;
+			p += length;
+			return p == line.end() || *p == ' ' || *p == '#';
 		}
 
-		template<InstructionEnum Opcode, uint32 Registers>
-		bool matchSimpleInstruction(const char *Name, const string &instruction, string &line)
+		// initial contents of memory pools, declared in the source code
+		struct MemoryData
 		{
-			if (instruction != string(Name))
-				return false;
-			insert(Opcode);
-			for (uint32 i = 0; i < Registers; i++)
-				params << getRegister(line);
-			return true;
-		}
+			std::vector<MemoryDataRecord> records; // offsets are relative to the values
+			std::vector<uint32> values;
+
+			void append(const MemoryData &other)
+			{
+				const uint32 offset = numeric_cast<uint32>(values.size());
+				for (MemoryDataRecord r : other.records)
+				{
+					r.offset += offset;
+					records.push_back(r);
+				}
+				values.insert(values.end(), other.values.begin(), other.values.end());
+			}
+		};
 
-		void processLine(string &line)
+		// compiled part of the source code, from one function declaration up to the next one
+		// instruction indices, parameters offsets and source lines are relative to the fragment
+		// jump and call targets are filled in when the fragments are linked together
+		struct Fragment
 		{
-			const string instruction = split(line);
+			std::vector<char> source; // to recognize unchanged fragments in next compilation
+			PointerRangeHolder<InstructionEnum> instructions;
+			PointerRangeHolder<uint32> paramsOffsets;
+			PointerRangeHolder<uint32> sourceLines;
+			MemoryBuffer paramsBuffer;
+			std::vector<LabelReplacement> labelsReplacements; // which positions in parameters should be updated to what position of label in a function
+			std::unordered_map<Label, uint32, LabelHash> labelNameToInstruction;
+			MemoryData memoryData;
+			Name currentFunction; // empty for the program scope
+		};
 
-#define MatchSimpleInstruction_0(Name) || matchSimpleInstruction<InstructionEnum::Name, 0>(CAGE_STRINGIZE(Name), instruction, line)
-#define MatchSimpleInstruction_1(Name) || matchSimpleInstruction<InstructionEnum::Name, 1>(CAGE_STRINGIZE(Name), instruction, line)
-#define MatchSimpleInstruction_2(Name) || matchSimpleInstruction<InstructionEnum::Name, 2>(CAGE_STRINGIZE(Name), instruction, line)
-#define MatchSimpleInstruction_3(Name) || matchSimpleInstruction<InstructionEnum::Name, 3>(CAGE_STRINGIZE(Name), instruction, line)
+		struct DataState : public Fragment
+		{
+			Serializer params = Serializer(paramsBuffer);
+			uint32 currentSourceLine = 0; // relative to the fragment
+			uint32 firstSourceLine = 0; // of the fragment
+		};
 
-			// registers
-			if (false
-				CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(MatchSimpleInstruction_0, indcpy))
-				CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(MatchSimpleInstruction_1, reset, condrst))
-				CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(MatchSimpleInstruction_2, copy, condcpy))
-				)
-				return;
-			if (instruction == "set")
+		// whole program assembled from the fragments
+		struct LinkedProgram : public Fragment
+		{
+			PointerRangeHolder<uint32> functionIndices;
+			PointerRangeHolder<FunctionNameRecord> functionNames;
+		};
+
+		// compiles single fragment, independently of all other fragments
+		struct FragmentCompiler : public DataState
+		{
+			void insert(InstructionEnum instruction)
 			{
-				insert(InstructionEnum::set);
-				params << getRegister(line);
-				params << toUint32(split(line));
-				return;
+				instructions.push_back(instruction);
+				paramsOffsets.push_back(numeric_cast<uint32>(paramsBuffer.size()));
+				sourceLines.push_back(currentSourceLine);
 			}
-			if (instruction == "iset")
+
+			void scopeExit()
 			{
-				insert(InstructionEnum::iset);
-				params << getRegister(line);
-				params << toSint32(split(line));
-				return;
+				// leaving function without return terminates the program
+				// leaving program scope is successful exit
+				insert(currentFunction.empty() ? InstructionEnum::exit : InstructionEnum::unreachable);
 			}
-			if (instruction == "fset")
+
+			void processLabel(Tokenizer &line)
 			{
-				insert(InstructionEnum::fset);
-				params << getRegister(line);
-				params << toFloat(split(line));
-				return;
+				validateName(line.line);
+				Label label;
+				label.label = Name(line.next());
+				label.function = currentFunction;
+				if (labelNameToInstruction.count(label))
+					CAGE_THROW_ERROR(Exception, "label name is not unique");
+				labelNameToInstruction[label] = numeric_cast<uint32>(instructions.size());
 			}
-			if (instruction == "condset")
+
+			void processJump(Tokenizer &line, InstructionEnum opcode)
 			{
-				insert(InstructionEnum::condset);
-				params << getRegister(line);
-				params << toUint32(split(line));
-				return;
+				validateName(line.line);
+				LabelReplacement label;
+				label.label = Name(line.next());
+				label.function = currentFunction;
+				insert(opcode);
+				label.paramsOffset = numeric_cast<uint32>(paramsBuffer.size());
+				label.sourceLine = currentSourceLine;
+				labelsReplacements.push_back(label);
+				params << uint32(m); // this value will be replaced by address of the label after parsing the source code has finished
 			}
-			if (instruction == "condiset")
+
+			void processFunction(Tokenizer &line)
 			{
-				insert(InstructionEnum::condiset);
-				params << getRegister(line);
-				params << toSint32(split(line));
-				return;
+				// the declaration is the first line of its fragment, the previous scope was closed at the end of the previous fragment
+				CAGE_ASSERT(currentSourceLine == 0 && instructions.empty());
+				validateName(line.line);
+				Label label;
+				label.label = label.function = Name(line.next());
+				labelNameToInstruction[label] = 0; // uniqueness of the name is checked when the fragments are merged
+				currentFunction = label.function;
 			}
-			if (instruction == "condfset")
+
+			void processCall(Tokenizer &line, InstructionEnum opcode)
 			{
-				insert(InstructionEnum::condfset);
-				params << getRegister(line);
-				params << toFloat(split(line));
-				return;
+				validateName(line.line);
+				LabelReplacement label;
+				label.label = label.function = Name(line.next());
+				label.call = true;
+				insert(opcode);
+				label.paramsOffset = numeric_cast<uint32>(paramsBuffer.size());
+				label.sourceLine = currentSourceLine;
+				labelsReplacements.push_back(label);
+				params << uint32(m); // this value will be replaced by address of the label after parsing the source code has finished
 			}
 
-			// arithmetics
-			if (false
-				CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(MatchSimpleInstruction_1, inc, dec, iinc, idec))
-				CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(MatchSimpleInstruction_2, iabs, fabs, fsqrt, flog, fsin, fcos, ftan, fasin, facos, fatan, ffloor, fround, fceil, s2f, u2f, f2s, f2u))
-				CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(MatchSimpleInstruction_3, add, sub, mul, div, mod, iadd, isub, imul, idiv, imod, fadd, fsub, fmul, fdiv, fpow, fatan2))
-				)
-				return;
+			void processBulkRead(Tokenizer &line, InstructionEnum opcode)
+			{
+				uint8 type, index;
+				getStructure(line, type, index);
+				if (type != 1 && type != 3)
+					CAGE_THROW_ERROR(Exception, "bulk read requires queue or memory pool");
+				insert(opcode);
+				params << type << index;
+			}
 
-			// logic
-			if (false
-				CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(MatchSimpleInstruction_1, inv, binv))
-				CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(MatchSimpleInstruction_3, shl, shr, rol, ror, band, bor, bxor))
-				|| matchSimpleInstruction<InstructionEnum::not_, 2>("not", instruction, line)
-				|| matchSimpleInstruction<InstructionEnum::bnot, 2>("bnot", instruction, line)
-				|| matchSimpleInstruction<InstructionEnum::and_, 3>("and", instruction, line)
-				|| matchSimpleInstruction<InstructionEnum::or_, 3>("or", instruction, line)
-				|| matchSimpleInstruction<InstructionEnum::xor_, 3>("xor", instruction, line)
-				)
-				return;
+			void processBulkWrite(Tokenizer &line, InstructionEnum opcode)
+			{
+				uint8 type, index;
+				getStructure(line, type, index);
+				if (type != 3)
+					CAGE_THROW_ERROR(Exception, "bulk write requires memory pool");
+				insert(opcode);
+				params << index;
+			}
 
-			// comparisons
-			if (false
-				CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(MatchSimpleInstruction_2, fisnan, fisinf, fisfin, fisnorm, test))
-				CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(MatchSimpleInstruction_3, eq, neq, lt, gt, lte, gte, ieq, ineq, ilt, igt, ilte, igte, feq, fneq, flt, fgt, flte, fgte))
-				)
-				return;
+			void processBinary(Tokenizer &line, InstructionEnum registerOpcode, InstructionEnum memoryOpcode)
+			{
+				if (Tokenizer(line).next().size() == 1)
+				{
+					insert(registerOpcode);
+					params << getRegister(line);
+					return;
+				}
+				uint8 type, index;
+				getStructure(line, type, index);
+				if (type != 3)
+					CAGE_THROW_ERROR(Exception, "binary input/output requires register or memory pool");
+				insert(memoryOpcode);
+				params << index;
+			}
 
-			// structures
-			if (instruction == "load")
+			void processData(Tokenizer &line, SyntaxEnum syntax)
 			{
-				uint8 dst = getRegister(line);
 				uint8 type, index;
-				uint32 address;
-				getStructure(line, type, index, address);
-				switch (type)
+				MemoryDataRecord r;
+				getStructure(line, type, index, r.address);
+				if (type != 3)
+					CAGE_THROW_ERROR(Exception, "data requires memory pool");
+				r.pool = index;
+				r.offset = numeric_cast<uint32>(memoryData.values.size());
+				while (!line.empty())
 				{
-				case 0:
-					insert(InstructionEnum::sload);
-					params << dst << index;
-					break;
-				case 1:
-					insert(InstructionEnum::qload);
-					params << dst << index;
-					break;
-				case 2:
-					insert(InstructionEnum::tload);
-					params << dst << index;
-					break;
-				case 3:
-					insert(InstructionEnum::mload);
-					params << dst << index << address;
-					break;
+					const Token t = line.next();
+					switch (syntax)
+					{
+					case SyntaxEnum::DataSint:
+					{
+						const sint32 v = toSint32(t);
+						memoryData.values.push_back(*(const uint32 *)&v);
+					} break;
+					case SyntaxEnum::DataFloat:
+					{
+						const float v = toFloat(t);
+						memoryData.values.push_back(*(const uint32 *)&v);
+					} break;
+					default:
+						memoryData.values.push_back(toUint32(t));
+						break;
+					}
 				}
-				return;
+				r.count = numeric_cast<uint32>(memoryData.values.size()) - r.offset;
+				if (r.count == 0)
+					CAGE_THROW_ERROR(Exception, "missing data values");
+				if (uint64(r.address) + r.count > uint32(m))
+					CAGE_THROW_ERROR(Exception, "data exceed address range");
+				memoryData.records.push_back(r);
 			}
-			if (instruction == "store")
+
+			void processLine(Tokenizer &line)
 			{
-				uint8 type, index;
-				uint32 address;
-				getStructure(line, type, index, address);
-				uint8 src = getRegister(line);
-				switch (type)
+				const Mnemonic *mn = findMnemonic(line.next());
+				if (!mn)
+					CAGE_THROW_ERROR(Exception, "unknown instruction");
+
+				switch (mn->syntax)
+				{
+				case SyntaxEnum::Registers:
+				{
+					insert(mn->opcode);
+					for (uint32 i = 0; i < mn->registers; i++)
+						params << getRegister(line);
+				} break;
+
+				// registers
+				case SyntaxEnum::RegisterUint:
+				{
+					insert(mn->opcode);
+					params << getRegister(line);
+					params << toUint32(line.next());
+				} break;
+				case SyntaxEnum::RegisterSint:
+				{
+					insert(mn->opcode);
+					params << getRegister(line);
+					params << toSint32(line.next());
+				} break;
+				case SyntaxEnum::RegisterFloat:
 				{
-				case 0:
-					insert(InstructionEnum::sstore);
+					insert(mn->opcode);
+					params << getRegister(line);
+					params << toFloat(line.next());
+				} break;
+
+				// structures
+				case SyntaxEnum::Load:
+				{
+					uint8 dst = getRegister(line);
+					uint8 type, index;
+					uint32 address;
+					getStructure(line, type, index, address);
+					switch (type)
+					{
+					case 0:
+						insert(InstructionEnum::sload);
+						params << dst << index;
+						break;
+					case 1:
+						insert(InstructionEnum::qload);
+						params << dst << index;
+						break;
+					case 2:
+						insert(InstructionEnum::tload);
+						params << dst << index;
+						break;
+					case 3:
+						insert(InstructionEnum::mload);
+						params << dst << index << address;
+						break;
+					}
+				} break;
+				case SyntaxEnum::Store:
+				{
+					uint8 type, index;
+					uint32 address;
+					getStructure(line, type, index, address);
+					uint8 src = getRegister(line);
+					switch (type)
+					{
+					case 0:
+						insert(InstructionEnum::sstore);
+						params << index << src;
+						break;
+					case 1:
+						insert(InstructionEnum::qstore);
+						params << index << src;
+						break;
+					case 2:
+						insert(InstructionEnum::tstore);
+						params << index << src;
+						break;
+					case 3:
+						insert(InstructionEnum::mstore);
+						params << index << address << src;
+						break;
+					}
+				} break;
+				case SyntaxEnum::IndLoad:
+				{
+					uint8 dst = getRegister(line);
+					uint8 type, index;
+					getStructure(line, type, index);
+					if (type != 3)
+						CAGE_THROW_ERROR(Exception, "indload requires memory pool");
+					insert(InstructionEnum::indload);
+					params << dst << index;
+				} break;
+				case SyntaxEnum::IndStore:
+				{
+					uint8 type, index;
+					getStructure(line, type, index);
+					if (type != 3)
+						CAGE_THROW_ERROR(Exception, "indstore requires memory pool");
+					uint8 src = getRegister(line);
+					insert(InstructionEnum::indstore);
 					params << index << src;
-					break;
-				case 1:
-					insert(InstructionEnum::qstore);
+				} break;
+				case SyntaxEnum::Pop:
+				{
+					uint8 dst = getRegister(line);
+					uint8 type, index;
+					getStructure(line, type, index);
+					if (type != 0)
+						CAGE_THROW_ERROR(Exception, "pop requires stack");
+					insert(InstructionEnum::pop);
+					params << dst << index;
+				} break;
+				case SyntaxEnum::Push:
+				{
+					uint8 type, index;
+					getStructure(line, type, index);
+					if (type != 0)
+						CAGE_THROW_ERROR(Exception, "push requires stack");
+					uint8 src = getRegister(line);
+					insert(InstructionEnum::push);
 					params << index << src;
-					break;
-				case 2:
-					insert(InstructionEnum::tstore);
+				} break;
+				case SyntaxEnum::Dequeue:
+				{
+					uint8 dst = getRegister(line);
+					uint8 type, index;
+					getStructure(line, type, index);
+					if (type != 1)
+						CAGE_THROW_ERROR(Exception, "dequeue requires queue");
+					insert(InstructionEnum::dequeue);
+					params << dst << index;
+				} break;
+				case SyntaxEnum::Enqueue:
+				{
+					uint8 type, index;
+					getStructure(line, type, index);
+					if (type != 1)
+						CAGE_THROW_ERROR(Exception, "enqueue requires queue");
+					uint8 src = getRegister(line);
+					insert(InstructionEnum::enqueue);
 					params << index << src;
-					break;
-				case 3:
-					insert(InstructionEnum::mstore);
-					params << index << address << src;
-					break;
+				} break;
+				case SyntaxEnum::Left:
+				{
+					uint8 type, index;
+					getStructure(line, type, index);
+					if (type != 2)
+						CAGE_THROW_ERROR(Exception, "left requires tape");
+					insert(InstructionEnum::left);
+					params << index;
+				} break;
+				case SyntaxEnum::Right:
+				{
+					uint8 type, index;
+					getStructure(line, type, index);
+					if (type != 2)
+						CAGE_THROW_ERROR(Exception, "right requires tape");
+					insert(InstructionEnum::right);
+					params << index;
+				} break;
+				case SyntaxEnum::Center:
+				{
+					uint8 type, index;
+					getStructure(line, type, index);
+					if (type != 2)
+						CAGE_THROW_ERROR(Exception, "center requires tape");
+					insert(InstructionEnum::center);
+					params << index;
+				} break;
+				case SyntaxEnum::Swap:
+				{
+					uint8 type1, index1, type2, index2;
+					getStructure(line, type1, index1);
+					getStructure(line, type2, index2);
+					if (type1 != type2)
+						CAGE_THROW_ERROR(Exception, "swap requires structures of same type");
+					switch (type1)
+					{
+					case 0: insert(InstructionEnum::sswap); break;
+					case 1: insert(InstructionEnum::qswap); break;
+					case 2: insert(InstructionEnum::tswap); break;
+					case 3: insert(InstructionEnum::mswap); break;
+					}
+					params << index1 << index2;
+				} break;
+				case SyntaxEnum::IndSwap:
+				{
+					uint8 type1, index1, type2, index2;
+					getStructure(line, type1, index1);
+					getStructure(line, type2, index2);
+					if (type1 != type2)
+						CAGE_THROW_ERROR(Exception, "indswap requires structures of same type");
+					if (index1 != 0 || index2 != 0)
+						CAGE_THROW_ERROR(Exception, "indswap requires A instance of structure to denote the type");
+					switch (type1)
+					{
+					case 0: insert(InstructionEnum::indsswap); break;
+					case 1: insert(InstructionEnum::indqswap); break;
+					case 2: insert(InstructionEnum::indtswap); break;
+					case 3: insert(InstructionEnum::indmswap); break;
+					}
+				} break;
+				case SyntaxEnum::Stat:
+				{
+					uint8 type, index;
+					getStructure(line, type, index);
+					switch (type)
+					{
+					case 0: insert(InstructionEnum::sstat); break;
+					case 1: insert(InstructionEnum::qstat); break;
+					case 2: insert(InstructionEnum::tstat); break;
+					case 3: insert(InstructionEnum::mstat); break;
+					}
+					params << index;
+				} break;
+				case SyntaxEnum::IndStat:
+				{
+					uint8 type, index;
+					getStructure(line, type, index);
+					if (index != 0)
+						CAGE_THROW_ERROR(Exception, "indstat requires A instance of structure to denote the type");
+					switch (type)
+					{
+					case 0: insert(InstructionEnum::indsstat); break;
+					case 1: insert(InstructionEnum::indqstat); break;
+					case 2: insert(InstructionEnum::indtstat); break;
+					case 3: insert(InstructionEnum::indmstat); break;
+					}
+				} break;
+				case SyntaxEnum::DataUint:
+				case SyntaxEnum::DataSint:
+				case SyntaxEnum::DataFloat:
+					return processData(line, mn->syntax);
+
+				// jumps
+				case SyntaxEnum::Label:
+					return processLabel(line);
+				case SyntaxEnum::Jump:
+					return processJump(line, mn->opcode);
+
+				// functions
+				case SyntaxEnum::Function:
+					return processFunction(line);
+				case SyntaxEnum::Call:
+					return processCall(line, mn->opcode);
+				case SyntaxEnum::Return:
+					return insert(mn->opcode);
+
+				// input/output
+				case SyntaxEnum::BulkRead:
+					return processBulkRead(line, mn->opcode);
+				case SyntaxEnum::BulkWrite:
+					return processBulkWrite(line, mn->opcode);
+				case SyntaxEnum::Binary:
+					return processBinary(line, mn->opcode, mn->alternative);
 				}
-				return;
 			}
-			if (instruction == "indload")
+
+			Holder<Fragment> compile(PointerRange<const Token> lines, uint32 firstLine)
 			{
-				uint8 dst = getRegister(line);
-				uint8 type, index;
-				getStructure(line, type, index);
-				if (type != 3)
-					CAGE_THROW_ERROR(Exception, "indload requires memory pool");
-				insert(InstructionEnum::indload);
-				params << dst << index;
-				return;
+				firstSourceLine = firstLine;
+				if (!lines.empty())
+					source.insert(source.end(), lines.begin()->begin(), (lines.end() - 1)->end());
+
+				for (; currentSourceLine < lines.size(); currentSourceLine++)
+				{
+					const Token fullLine = lines[currentSourceLine];
+					try
+					{
+						Tokenizer line = { decomment(fullLine) };
+						if (line.empty())
+							continue;
+						processLine(line);
+						if (!line.empty())
+							CAGE_THROW_ERROR(Exception, "superfluous argument");
+					}
+					catch (...)
+					{
+						CAGE_LOG_THROW(stringizer() + "line number: " + (firstSourceLine + currentSourceLine + 1));
+						CAGE_LOG_THROW(string(PointerRange<const char>(fullLine.begin(), fullLine.begin() + min(fullLine.size(), uintPtr(string::MaxLength)))));
+						throw;
+					}
+				}
+				scopeExit();
+
+				CAGE_ASSERT(instructions.size() == paramsOffsets.size());
+				CAGE_ASSERT(instructions.size() == sourceLines.size());
+				return detail::systemArena().createHolder<Fragment>(templates::move((Fragment &)*this));
 			}
-			if (instruction == "indstore")
+		};
+
+		struct FragmentTask
+		{
+			PointerRange<const Token> lines;
+			uint32 firstLine = 0;
+			Holder<Fragment> fragment;
+			Name function; // declared at the beginning of the fragment, known even if the compilation fails later
+			std::exception_ptr error;
+			bool finished = false;
+		};
+
+		void compileTask(FragmentTask &task)
+		{
+			FragmentCompiler compiler;
+			try
 			{
-				uint8 type, index;
-				getStructure(line, type, index);
-				if (type != 3)
-					CAGE_THROW_ERROR(Exception, "indstore requires memory pool");
-				uint8 src = getRegister(line);
-				insert(InstructionEnum::indstore);
-				params << index << src;
-				return;
+				task.fragment = compiler.compile(task.lines, task.firstLine);
+				task.function = task.fragment->currentFunction;
 			}
-			if (instruction == "indindload")
+			catch (...)
 			{
-				insert(InstructionEnum::indindload);
-				params << getRegister(line);
-				return;
+				task.function = compiler.currentFunction;
+				task.error = std::current_exception();
 			}
-			if (instruction == "indindstore")
+			task.finished = true;
+		}
+
+		// splits the source code into lines, and into fragments, each function is one fragment
+		void splitSource(PointerRange<const char> sourceCode, std::vector<Token> &lines, std::vector<uint32> &firstLines)
+		{
+			firstLines.push_back(0);
+			Holder<LineReader> reader = newLineReader(sourceCode);
+			for (PointerRange<const char> fullLine; reader->readLine(fullLine);)
 			{
-				insert(InstructionEnum::indindstore);
-				params << getRegister(line);
-				return;
+				if (isFunctionDeclaration(fullLine))
+					firstLines.push_back(numeric_cast<uint32>(lines.size()));
+				lines.push_back(fullLine);
 			}
-			if (instruction == "pop")
+		}
+
+		template<class T>
+		PointerRange<const char> bytes(PointerRange<const T> range)
+		{
+			return { (const char *)range.begin(), (const char *)range.end() };
+		}
+
+		void serializeMemoryData(Serializer &ser, const MemoryData &data)
+		{
+			ser << numeric_cast<uint32>(data.records.size());
+			ser.write(bytes<MemoryDataRecord>(data.records));
+			ser << numeric_cast<uint32>(data.values.size());
+			ser.write(bytes<uint32>(data.values));
+		}
+
+		void deserializeMemoryData(Deserializer &des, MemoryData &data)
+		{
+			uint32 count = 0;
+			des >> count;
+			data.records.resize(count);
+			des.read(PointerRange<char>((char *)data.records.data(), (char *)(data.records.data() + count)));
+			des >> count;
+			data.values.resize(count);
+			des.read(PointerRange<char>((char *)data.values.data(), (char *)(data.values.data() + count)));
+			for (const MemoryDataRecord &r : data.records)
+				if (r.pool >= 26 || r.offset > data.values.size() || r.count > data.values.size() - r.offset || uint64(r.address) + r.count > uint32(m))
+					CAGE_THROW_ERROR(Exception, "module buffer has invalid memory data");
+		}
+
+		struct ModuleHeader
+		{
+			char magic[8] = { 'q', 'a', 's', 'm', 'm', 'o', 'd', 0 };
+			uint32 version = ProgramFormatVersion;
+		};
+	}
+
+	// functions compiled without the program scope, their calls are resolved when linked with a program
+	struct ModuleImpl : public Module
+	{
+		std::vector<char> sourceCode;
+		std::vector<SourceLineRecord> sourceCodeLines; // relative to the source code of the module
+		std::vector<Holder<Fragment>> fragments; // one per function
+		std::vector<uint32> firstLines; // of each fragment
+		MemoryData memoryData; // declared outside of the functions
+	};
+
+	struct CompilerImpl : public Compiler
+	{
+		const CompilerCreateConfig config;
+		std::unordered_map<uint32, Holder<Fragment>> previousFragments; // from last successful compilation, by hash of their source code
+		std::unordered_map<Name, uint32, NameHash> functionNameToIndex; // functions declared so far in current compilation
+
+		std::vector<FragmentTask> tasks; // fragments to compile in current compilation
+		std::atomic<uint32> nextTask = 0;
+
+		CompilerImpl(const CompilerCreateConfig &config) : config(config)
+		{}
+
+		// runs on each of the threads
+		void compileTasks()
+		{
+			while (true)
 			{
-				uint8 dst = getRegister(line);
-				uint8 type, index;
-				getStructure(line, type, index);
-				if (type != 0)
-					CAGE_THROW_ERROR(Exception, "pop requires stack");
-				insert(InstructionEnum::pop);
-				params << dst << index;
-				return;
+				const uint32 i = nextTask++;
+				if (i >= tasks.size())
+					return;
+				compileTask(tasks[i]);
 			}
-			if (instruction == "push")
+		}
+
+		// concatenates the fragments and resolves jump and call targets
+		// the instruction closing each fragment is placed on the line where the next fragment starts (or after the last line)
+		void link(PointerRange<const Holder<Fragment>> fragments, PointerRange<const uint32> firstLines, uint32 linesCount, LinkedProgram &linked) const
+		{
+			PointerRangeHolder<InstructionEnum> &instructions = linked.instructions;
+			PointerRangeHolder<uint32> &paramsOffsets = linked.paramsOffsets;
+			PointerRangeHolder<uint32> &sourceLines = linked.sourceLines;
+			MemoryBuffer &paramsBuffer = linked.paramsBuffer;
+			std::vector<uint32> firstInstructions, firstParams;
+			for (uint32 k = 0; k < fragments.size(); k++)
 			{
-				uint8 type, index;
-				getStructure(line, type, index);
-				if (type != 0)
-					CAGE_THROW_ERROR(Exception, "push requires stack");
-				uint8 src = getRegister(line);
-				insert(InstructionEnum::push);
-				params << index << src;
-				return;
+				const Fragment &f = *fragments[k];
+				firstInstructions.push_back(numeric_cast<uint32>(instructions.size()));
+				firstParams.push_back(numeric_cast<uint32>(paramsBuffer.size()));
+				for (uint32 i = 0; i < f.instructions.size(); i++)
+				{
+					instructions.push_back(f.instructions[i]);
+					paramsOffsets.push_back(f.paramsOffsets[i] + firstParams[k]);
+					sourceLines.push_back(i + 1 == f.instructions.size() ? (k + 1 < fragments.size() ? firstLines[k + 1] : linesCount) : f.sourceLines[i] + firstLines[k]);
+					linked.functionIndices.push_back(k);
+				}
+				paramsBuffer.resize(firstParams[k] + f.paramsBuffer.size());
+				if (f.paramsBuffer.size())
+					detail::memcpy(paramsBuffer.data() + firstParams[k], f.paramsBuffer.data(), f.paramsBuffer.size());
+				FunctionNameRecord r;
+				r.length = f.currentFunction.length();
+				detail::memcpy(r.value, f.currentFunction.data(), f.currentFunction.length());
+				linked.functionNames.push_back(r);
 			}
-			if (instruction == "dequeue")
+
+			for (uint32 k = 0; k < fragments.size(); k++)
 			{
-				uint8 dst = getRegister(line);
-				uint8 type, index;
-				getStructure(line, type, index);
-				if (type != 1)
-					CAGE_THROW_ERROR(Exception, "dequeue requires queue");
-				insert(InstructionEnum::dequeue);
-				params << dst << index;
-				return;
+				const Fragment &f = *fragments[k];
+				for (const LabelReplacement &label : f.labelsReplacements)
+				{
+					uint32 &p = *(uint32 *)(paramsBuffer.data() + firstParams[k] + label.paramsOffset);
+					CAGE_ASSERT(p == m);
+					if (label.call)
+					{
+						auto it = functionNameToIndex.find(label.function);
+						if (it != functionNameToIndex.end())
+							p = firstInstructions[it->second];
+					}
+					else
+					{
+						auto it = f.labelNameToInstruction.find(label);
+						if (it != f.labelNameToInstruction.end())
+							p = firstInstructions[k] + it->second;
+					}
+					if (p == m)
+					{
+						CAGE_LOG_THROW(stringizer() + "function: " + label.function);
+						CAGE_LOG_THROW(stringizer() + "label: " + label.label);
+						CAGE_LOG_THROW(stringizer() + "line number: " + (firstLines[k] + label.sourceLine + 1));
+						CAGE_THROW_ERROR(Exception, "label not found");
+					}
+				}
 			}
-			if (instruction == "enqueue")
+		}
+
+		bool optimizationsEnabled() const
+		{
+			return config.constantPropagation || config.deadCodeElimination || config.jumpThreading || config.inlining;
+		}
+
+		// compiles all fragments of the source code, reusing fragments from the previous compilation
+		std::vector<Holder<Fragment>> compileFragments(PointerRange<const Token> lines, PointerRange<const uint32> firstLines)
+		{
+			// find the fragments that changed since the previous compilation
+			std::vector<Holder<Fragment>> fragments; // reused fragments, the others are filled in from the tasks
+			std::vector<uint32> hashes;
+			std::vector<uint32> fragmentTasks; // index of task for each fragment, or m
+			tasks.clear();
+			for (uint32 k = 0; k < firstLines.size(); k++)
 			{
-				uint8 type, index;
-				getStructure(line, type, index);
-				if (type != 1)
-					CAGE_THROW_ERROR(Exception, "enqueue requires queue");
-				uint8 src = getRegister(line);
-				insert(InstructionEnum::enqueue);
-				params << index << src;
-				return;
+				const uint32 first = firstLines[k];
+				const uint32 last = k + 1 < firstLines.size() ? firstLines[k + 1] : numeric_cast<uint32>(lines.size());
+				const PointerRange<const Token> fragmentLines = { lines.data() + first, lines.data() + last };
+				const Token source = fragmentLines.empty() ? Token() : Token(fragmentLines.begin()->begin(), (fragmentLines.end() - 1)->end());
+				const uint32 hash = hashChars(source.data(), source.size());
+				hashes.push_back(hash);
+				auto it = previousFragments.find(hash);
+				if (it != previousFragments.end() && it->second->source.size() == source.size() && detail::memcmp(it->second->source.data(), source.data(), source.size()) == 0)
+				{
+					fragments.push_back(it->second.share());
+					fragmentTasks.push_back(m);
+				}
+				else
+				{
+					FragmentTask t;
+					t.lines = fragmentLines;
+					t.firstLine = first;
+					fragments.push_back({});
+					fragmentTasks.push_back(numeric_cast<uint32>(tasks.size()));
+					tasks.push_back(templates::move(t));
+				}
 			}
-			if (instruction == "left")
+
+			// compile the changed fragments in parallel, or one by one while merging them
+			const uint32 threadsCount = min(config.threads == m ? numeric_cast<uint32>(processorsCount()) : config.threads, numeric_cast<uint32>(tasks.size()));
+			if (threadsCount > 1)
 			{
-				uint8 type, index;
-				getStructure(line, type, index);
-				if (type != 2)
-					CAGE_THROW_ERROR(Exception, "left requires tape");
-				insert(InstructionEnum::left);
-				params << index;
-				return;
+				nextTask = 0;
+				std::vector<Holder<Thread>> threads;
+				for (uint32 i = 1; i < threadsCount; i++)
+					threads.push_back(newThread(Delegate<void()>().bind<CompilerImpl, &CompilerImpl::compileTasks>(this), stringizer() + "qasm compiler " + i));
+				compileTasks();
+				for (Holder<Thread> &t : threads)
+					t->wait();
 			}
-			if (instruction == "right")
+
+			// merge the fragments in order of the source code, reporting the first error
+			std::unordered_map<uint32, Holder<Fragment>> currentFragments;
+			functionNameToIndex.clear();
+			for (uint32 k = 0; k < firstLines.size(); k++)
 			{
-				uint8 type, index;
-				getStructure(line, type, index);
-				if (type != 2)
-					CAGE_THROW_ERROR(Exception, "right requires tape");
-				insert(InstructionEnum::right);
-				params << index;
-				return;
+				Holder<Fragment> &f = fragments[k];
+				Name function = f ? f->currentFunction : Name();
+				FragmentTask *task = fragmentTasks[k] == m ? nullptr : &tasks[fragmentTasks[k]];
+				if (task)
+				{
+					if (!task->finished)
+						compileTask(*task);
+					function = task->function;
+				}
+				if (k > 0 && !function.empty() && functionNameToIndex.count(function))
+				{
+					const uint32 first = firstLines[k];
+					CAGE_LOG_THROW(stringizer() + "line number: " + (first + 1));
+					CAGE_LOG_THROW(string(PointerRange<const char>(lines[first].begin(), lines[first].begin() + min(lines[first].size(), uintPtr(string::MaxLength)))));
+					CAGE_THROW_ERROR(Exception, "function name is not unique");
+				}
+				if (task)
+				{
+					if (task->error)
+						std::rethrow_exception(task->error);
+					f = templates::move(task->fragment);
+				}
+				functionNameToIndex[function] = k;
+				currentFragments[hashes[k]] = f.share();
 			}
-			if (instruction == "center")
+			tasks.clear();
+			std::swap(previousFragments, currentFragments);
+			return fragments;
+		}
+
+		Holder<Program> compile(PointerRange<const char> sourceCode, PointerRange<const Module *const> modules)
+		{
+			std::vector<Token> lines;
+			std::vector<uint32> firstLines;
+			splitSource(sourceCode, lines, firstLines);
+			std::vector<Holder<Fragment>> fragments = compileFragments(lines, firstLines);
+
+			// memory data in order of the source code, including the modules
+			LinkedProgram linked;
+			for (const Holder<Fragment> &f : fragments)
+				linked.memoryData.append(f->memoryData);
+
+			PointerRangeHolder<SourceLineRecord> sourceCodeLines;
+			for (const Token &l : lines)
 			{
-				uint8 type, index;
-				getStructure(line, type, index);
-				if (type != 2)
-					CAGE_THROW_ERROR(Exception, "center requires tape");
-				insert(InstructionEnum::center);
-				params << index;
-				return;
+				SourceLineRecord r;
+				r.offset = numeric_cast<uint32>(l.begin() - sourceCode.begin());
+				r.length = numeric_cast<uint32>(l.size());
+				sourceCodeLines.push_back(r);
 			}
-			if (instruction == "swap")
+
+			// the functions of the modules follow the source code, as if they were written there
+			std::vector<char> linkedSource;
+			if (!modules.empty())
+				linkedSource.insert(linkedSource.end(), sourceCode.begin(), sourceCode.end());
+			for (const Module *module : modules)
 			{
-				uint8 type1, index1, type2, index2;
-				getStructure(line, type1, index1);
-				getStructure(line, type2, index2);
-				if (type1 != type2)
-					CAGE_THROW_ERROR(Exception, "swap requires structures of same type");
-				switch (type1)
+				const ModuleImpl *impl = (const ModuleImpl *)module;
+				if (!linkedSource.empty() && linkedSource.back() != '\n')
+					linkedSource.push_back('\n');
+				const uint32 offset = numeric_cast<uint32>(linkedSource.size());
+				const uint32 firstLine = numeric_cast<uint32>(sourceCodeLines.size());
+				linkedSource.insert(linkedSource.end(), impl->sourceCode.begin(), impl->sourceCode.end());
+				for (SourceLineRecord r : impl->sourceCodeLines)
 				{
-				case 0: insert(InstructionEnum::sswap); break;
-				case 1: insert(InstructionEnum::qswap); break;
-				case 2: insert(InstructionEnum::tswap); break;
-				case 3: insert(InstructionEnum::mswap); break;
+					r.offset += offset;
+					sourceCodeLines.push_back(r);
 				}
-				params << index1 << index2;
-				return;
-			}
-			if (instruction == "indswap")
-			{
-				uint8 type1, index1, type2, index2;
-				getStructure(line, type1, index1);
-				getStructure(line, type2, index2);
-				if (type1 != type2)
-					CAGE_THROW_ERROR(Exception, "indswap requires structures of same type");
-				if (index1 != 0 || index2 != 0)
-					CAGE_THROW_ERROR(Exception, "indswap requires A instance of structure to denote the type");
-				switch (type1)
-				{
-				case 0: insert(InstructionEnum::indsswap); break;
-				case 1: insert(InstructionEnum::indqswap); break;
-				case 2: insert(InstructionEnum::indtswap); break;
-				case 3: insert(InstructionEnum::indmswap); break;
+				linked.memoryData.append(impl->memoryData);
+				for (uint32 k = 0; k < impl->fragments.size(); k++)
+				{
+					const Fragment &f = *impl->fragments[k];
+					if (functionNameToIndex.count(f.currentFunction))
+					{
+						const SourceLineRecord &r = impl->sourceCodeLines[impl->firstLines[k]];
+						CAGE_LOG_THROW(stringizer() + "line number: " + (firstLine + impl->firstLines[k] + 1));
+						CAGE_LOG_THROW(string(PointerRange<const char>(impl->sourceCode.data() + r.offset, impl->sourceCode.data() + r.offset + min(r.length, uint32(string::MaxLength)))));
+						CAGE_THROW_ERROR(Exception, "function name is not unique");
+					}
+					functionNameToIndex[f.currentFunction] = numeric_cast<uint32>(fragments.size());
+					firstLines.push_back(firstLine + impl->firstLines[k]);
+					fragments.push_back(impl->fragments[k].share());
+					linked.memoryData.append(f.memoryData);
 				}
-				return;
 			}
-			if (instruction == "stat")
+
+			link(fragments, firstLines, numeric_cast<uint32>(sourceCodeLines.size()), linked);
+			CAGE_ASSERT(linked.instructions.size() == linked.functionIndices.size());
+
+			// disabled before the optimizations, which could otherwise fold the instructions away
+			if (!config.disabledInstructions.empty())
 			{
-				uint8 type, index;
-				getStructure(line, type, index);
-				switch (type)
+				const std::bitset<InstructionsCount> disabled = instructionsMask(config.disabledInstructions);
+				for (uint32 i = 0; i < linked.instructions.size(); i++)
 				{
-				case 0: insert(InstructionEnum::sstat); break;
-				case 1: insert(InstructionEnum::qstat); break;
-				case 2: insert(InstructionEnum::tstat); break;
-				case 3: insert(InstructionEnum::mstat); break;
+					InstructionEnum &ins = linked.instructions[i];
+					if (!disabled[uint32(ins)])
+						continue;
+					CAGE_LOG(SeverityEnum::Warning, "qasm", stringizer() + "line " + (linked.sourceLines[i] + 1) + ": instruction " + instructionName(ins) + " is disabled");
+					ins = InstructionEnum::disabled;
 				}
-				params << index;
-				return;
 			}
-			if (instruction == "indstat")
+
+			ProgramSections sections;
+			sections.instructions = linked.instructions;
+			sections.paramsOffsets = linked.paramsOffsets;
+			sections.sourceLines = linked.sourceLines;
+			sections.functionIndices = linked.functionIndices;
+			sections.params = linked.paramsBuffer;
+			sections.functionNames = linked.functionNames;
+			sections.memoryData = linked.memoryData.records;
+			sections.memoryDataValues = linked.memoryData.values;
+			if (config.keepSourceCode)
 			{
-				uint8 type, index;
-				getStructure(line, type, index);
-				if (index != 0)
-					CAGE_THROW_ERROR(Exception, "indstat requires A instance of structure to denote the type");
-				switch (type)
-				{
-				case 0: insert(InstructionEnum::indsstat); break;
-				case 1: insert(InstructionEnum::indqstat); break;
-				case 2: insert(InstructionEnum::indtstat); break;
-				case 3: insert(InstructionEnum::indmstat); break;
-				}
-				return;
+				sections.sourceCode = modules.empty() ? sourceCode : PointerRange<const char>(linkedSource);
+				sections.sourceCodeLines = sourceCodeLines;
 			}
 
-			// jumps
-			if (instruction == "label")
-				return processLabel(line);
-			if (instruction == "jump")
-				return processJump(line, false);
-			if (instruction == "condjmp")
-				return processJump(line, true);
-
-			// functions
-			if (instruction == "function")
-				return processFunction(line);
-			if (instruction == "call")
-				return processCall(line, false);
-			if (instruction == "condcall")
-				return processCall(line, true);
-			if (instruction == "return")
-				return processReturn(line, false);
-			if (instruction == "condreturn")
-				return processReturn(line, true);
-
-			// input/output
-			if (false
-				CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(MatchSimpleInstruction_0, rstat, wstat, readln, rreset, rclear, writeln, wreset, wclear, rwswap))
-				CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(MatchSimpleInstruction_1, read, iread, fread, cread, write, iwrite, fwrite, cwrite))
-				)
-				return;
-
-			// random
-			if (false
-				CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(MatchSimpleInstruction_1, rand, irand, frand))
-				)
-				return;
-
-			// miscellaneous
-			if (false
-				CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(MatchSimpleInstruction_0, breakpoint, terminate))
-				)
-				return;
-
-			CAGE_THROW_ERROR(Exception, "unknown instruction");
+			Holder<ProgramImpl> p = detail::systemArena().createHolder<ProgramImpl>();
+			p->storage = optimizationsEnabled() ? programOptimize(config, sections) : programSerialize(sections, true);
+			(ProgramSections &)*p = programDeserialize(p->storage);
+			return templates::move(p).cast<Program>();
 		}
 
-		void processLabelReplacements()
+		Holder<Module> compileModule(PointerRange<const char> sourceCode)
 		{
-			CAGE_ASSERT(functionIndexToName.size() == functionNameToIndex.size());
-			for (const LabelReplacement &label : labelsReplacements)
+			std::vector<Token> lines;
+			std::vector<uint32> firstLines;
+			splitSource(sourceCode, lines, firstLines);
+			std::vector<Holder<Fragment>> fragments = compileFragments(lines, firstLines);
+
+			// the program scope contains the exit only, and memory data
+			if (fragments[0]->instructions.size() != 1)
+			{
+				CAGE_LOG_THROW(stringizer() + "line number: " + (fragments[0]->sourceLines[0] + 1));
+				CAGE_THROW_ERROR(Exception, "module may contain functions and data only");
+			}
+
+			// jumps are resolved within the functions, calls are resolved when linked
+			for (uint32 k = 1; k < fragments.size(); k++)
 			{
-				uint32 &p = *(uint32 *)(paramsBuffer.data() + label.paramsOffset);
-				CAGE_ASSERT(p == m);
-				auto it = labelNameToInstruction.find(label);
-				if (it == labelNameToInstruction.end())
+				const Fragment &f = *fragments[k];
+				for (const LabelReplacement &label : f.labelsReplacements)
 				{
+					if (label.call || f.labelNameToInstruction.count(label))
+						continue;
 					CAGE_LOG_THROW(stringizer() + "function: " + label.function);
 					CAGE_LOG_THROW(stringizer() + "label: " + label.label);
-					CAGE_LOG_THROW(stringizer() + "line number: " + (label.sourceLine + 1));
+					CAGE_LOG_THROW(stringizer() + "line number: " + (firstLines[k] + label.sourceLine + 1));
 					CAGE_THROW_ERROR(Exception, "label not found");
 				}
-				p = it->second;
 			}
-		}
-
-		Holder<Program> compile(PointerRange<const char> sourceCode)
-		{
-			(DataState &)*this = DataState();
-			params = Serializer(paramsBuffer); // update the buffer the serializer uses
-			functionNameToIndex[""] = 0;
-			functionIndexToName.push_back("");
 
-			Holder<LineReader> lines = newLineReader(sourceCode);
-			for (string fullLine; lines->readLine(fullLine); currentSourceLine++)
+			Holder<ModuleImpl> mod = detail::systemArena().createHolder<ModuleImpl>();
+			mod->sourceCode = std::vector<char>(sourceCode.begin(), sourceCode.end());
+			for (const Token &l : lines)
 			{
-				try
-				{
-					string line = decomment(fullLine);
-					if (line.empty())
-						continue;
-					processLine(line);
-					if (!line.empty())
-						CAGE_THROW_ERROR(Exception, "superfluous argument");
-				}
-				catch (...)
-				{
-					CAGE_LOG_THROW(stringizer() + "line number: " + (currentSourceLine + 1));
-					CAGE_LOG_THROW(fullLine);
-					throw;
-				}
+				SourceLineRecord r;
+				r.offset = numeric_cast<uint32>(l.begin() - sourceCode.begin());
+				r.length = numeric_cast<uint32>(l.size());
+				mod->sourceCodeLines.push_back(r);
 			}
-			scopeExit();
-			processLabelReplacements();
-
-			CAGE_ASSERT(instructions.size() == paramsOffsets.size());
-			CAGE_ASSERT(instructions.size() == sourceLines.size());
-			CAGE_ASSERT(instructions.size() == functionIndices.size());
-
-			Holder<ProgramImpl> p = detail::systemArena().createHolder<ProgramImpl>();
-			p->sourceCode = PointerRangeHolder<const char>(sourceCode);
-			p->instructions = instructions;
-			p->paramsOffsets = paramsOffsets;
-			p->sourceLines = sourceLines;
-			p->functionIndices = functionIndices;
-			p->params = PointerRangeHolder<const char>(PointerRange<const char>(paramsBuffer));
-			p->functionNames = functionIndexToName;
-			return templates::move(p).cast<Program>();
+			mod->memoryData = fragments[0]->memoryData;
+			for (uint32 k = 1; k < fragments.size(); k++)
+			{
+				mod->fragments.push_back(templates::move(fragments[k]));
+				mod->firstLines.push_back(firstLines[k]);
+			}
+			return templates::move(mod).cast<Module>();
 		}
 	};
 
-	Holder<Compiler> newCompiler()
+	Holder<Compiler> newCompiler(const CompilerCreateConfig &config)
 	{
-		return detail::systemArena().createImpl<Compiler, CompilerImpl>();
+		return detail::systemArena().createImpl<Compiler, CompilerImpl>(config);
 	}
 
 	Holder<Program> Compiler::compile(PointerRange<const char> sourceCode)
 	{
 		CompilerImpl *impl = (CompilerImpl *)this;
-		return impl->compile(sourceCode);
+		return impl->compile(sourceCode, {});
+	}
+
+	Holder<Program> Compiler::compile(PointerRange<const char> sourceCode, PointerRange<const Module *const> modules)
+	{
+		CompilerImpl *impl = (CompilerImpl *)this;
+		return impl->compile(sourceCode, modules);
+	}
+
+	Holder<Module> Compiler::compileModule(PointerRange<const char> sourceCode)
+	{
+		CompilerImpl *impl = (CompilerImpl *)this;
+		return impl->compileModule(sourceCode);
+	}
+
+	Holder<PointerRange<char>> Module::exportBuffer() const
+	{
+		const ModuleImpl *impl = (const ModuleImpl *)this;
+		MemoryBuffer buffer;
+		Serializer ser(buffer);
+		const ModuleHeader header;
+		ser << header;
+		ser << numeric_cast<uint32>(impl->sourceCode.size());
+		ser.write(impl->sourceCode);
+		ser << numeric_cast<uint32>(impl->sourceCodeLines.size());
+		ser.write(bytes<SourceLineRecord>(impl->sourceCodeLines));
+		serializeMemoryData(ser, impl->memoryData);
+		ser << numeric_cast<uint32>(impl->fragments.size());
+		for (uint32 k = 0; k < impl->fragments.size(); k++)
+		{
+			const Fragment &f = *impl->fragments[k];
+			ser << impl->firstLines[k] << f.currentFunction;
+			ser << numeric_cast<uint32>(f.instructions.size());
+			ser.write(bytes<InstructionEnum>(f.instructions));
+			ser.write(bytes<uint32>(f.paramsOffsets));
+			ser.write(bytes<uint32>(f.sourceLines));
+			ser << numeric_cast<uint32>(f.paramsBuffer.size());
+			ser.write(f.paramsBuffer);
+			ser << numeric_cast<uint32>(f.labelsReplacements.size());
+			for (const LabelReplacement &l : f.labelsReplacements)
+				ser << l.function << l.label << l.paramsOffset << l.sourceLine << l.call;
+			ser << numeric_cast<uint32>(f.labelNameToInstruction.size());
+			for (const auto &it : f.labelNameToInstruction)
+				ser << it.first.function << it.first.label << it.second;
+			serializeMemoryData(ser, f.memoryData);
+		}
+		return PointerRangeHolder<char>(PointerRange<const char>(buffer));
+	}
+
+	Holder<Module> newModule(PointerRange<const char> buffer)
+	{
+		Deserializer des(buffer);
+		ModuleHeader header;
+		des >> header;
+		if (detail::memcmp(header.magic, ModuleHeader().magic, sizeof(header.magic)) != 0)
+			CAGE_THROW_ERROR(Exception, "module buffer has invalid magic");
+		if (header.version != ProgramFormatVersion)
+			CAGE_THROW_ERROR(Exception, "module buffer has unsupported version");
+
+		Holder<ModuleImpl> mod = detail::systemArena().createHolder<ModuleImpl>();
+		uint32 count = 0;
+		des >> count;
+		mod->sourceCode.resize(count);
+		des.read(mod->sourceCode);
+		des >> count;
+		mod->sourceCodeLines.resize(count);
+		des.read(PointerRange<char>((char *)mod->sourceCodeLines.data(), (char *)(mod->sourceCodeLines.data() + count)));
+		for (const SourceLineRecord &l : mod->sourceCodeLines)
+			if (l.offset > mod->sourceCode.size() || l.length > mod->sourceCode.size() - l.offset)
+				CAGE_THROW_ERROR(Exception, "module buffer has invalid source code line");
+		deserializeMemoryData(des, mod->memoryData);
+		uint32 fragments = 0;
+		des >> fragments;
+		for (uint32 k = 0; k < fragments; k++)
+		{
+			Holder<Fragment> f = detail::systemArena().createHolder<Fragment>();
+			uint32 firstLine = 0;
+			des >> firstLine >> f->currentFunction;
+			if (firstLine >= mod->sourceCodeLines.size() || (!mod->firstLines.empty() && firstLine <= mod->firstLines.back()) || f->currentFunction.empty())
+				CAGE_THROW_ERROR(Exception, "module buffer has invalid function");
+			mod->firstLines.push_back(firstLine);
+			des >> count;
+			f->instructions.resize(count);
+			f->paramsOffsets.resize(count);
+			f->sourceLines.resize(count);
+			des.read(PointerRange<char>((char *)f->instructions.data(), (char *)(f->instructions.data() + count)));
+			des.read(PointerRange<char>((char *)f->paramsOffsets.data(), (char *)(f->paramsOffsets.data() + count)));
+			des.read(PointerRange<char>((char *)f->sourceLines.data(), (char *)(f->sourceLines.data() + count)));
+			des >> count;
+			f->paramsBuffer.resize(count);
+			des.read(f->paramsBuffer);
+			for (uint32 i = 0; i < f->instructions.size(); i++)
+			{
+				if (f->instructions[i] > InstructionEnum::disabled)
+					CAGE_THROW_ERROR(Exception, "module buffer has invalid instruction");
+				if (f->paramsOffsets[i] > f->paramsBuffer.size())
+					CAGE_THROW_ERROR(Exception, "module buffer has invalid parameters offset");
+			}
+			des >> count;
+			for (uint32 i = 0; i < count; i++)
+			{
+				LabelReplacement l;
+				des >> l.function >> l.label >> l.paramsOffset >> l.sourceLine >> l.call;
+				if (uint64(l.paramsOffset) + sizeof(uint32) > f->paramsBuffer.size() || *(const uint32 *)(f->paramsBuffer.data() + l.paramsOffset) != m)
+					CAGE_THROW_ERROR(Exception, "module buffer has invalid label replacement");
+				f->labelsReplacements.push_back(l);
+			}
+			des >> count;
+			for (uint32 i = 0; i < count; i++)
+			{
+				Label l;
+				uint32 instruction = 0;
+				des >> l.function >> l.label >> instruction;
+				if (instruction > f->instructions.size())
+					CAGE_THROW_ERROR(Exception, "module buffer has invalid label");
+				f->labelNameToInstruction[l] = instruction;
+			}
+			deserializeMemoryData(des, f->memoryData);
+			mod->fragments.push_back(templates::move(f));
+		}
+		if (des.available() != 0)
+			CAGE_THROW_ERROR(Exception, "module buffer has unexpected data");
+		return templates::move(mod).cast<Module>();
 	}
 }
@@ -6,8 +6,12 @@
 #include <cage-core/random.h>
 
 #include "program.h"
+#include "characters.h"
+#include "instructions.h"
+#include "verifier.h"
 
 #include <vector>
+#include <algorithm> // lower_bound
 #include <cmath> // isnan etc
 
 namespace qasm
@@ -203,16 +207,29 @@ namespace qasm
 			std::vector<uint32> data;
 			bool readOnly = false;
 
+			void checkWritable() const
+			{
+				if (readOnly)
+					CAGE_THROW_ERROR(Exception, "memory pool is read only");
+			}
+
 			StructureStat stat() const
 			{
 				StructureStat s;
 				s.capacity = capacity;
-				s.size = numeric_cast<uint32>(data.size());
+				s.size = enabled ? capacity : 0; // even if not allocated yet
 				s.enabled = enabled;
 				s.writable = !readOnly;
 				return s;
 			}
 
+			// pools that the program does not access are allocated only when requested by the host
+			void allocate()
+			{
+				if (enabled && data.empty())
+					data.resize(capacity, 0);
+			}
+
 			uint32 load(uint32 addr) const
 			{
 				checkEnabled();
@@ -224,15 +241,27 @@ namespace qasm
 			void store(uint32 addr, uint32 value)
 			{
 				checkEnabled();
+				checkWritable();
 				if (addr >= data.size())
 					CAGE_THROW_ERROR(Exception, "memory address out of bounds");
 				data[addr] = value;
 			}
+
+			PointerRange<uint32> range(uint32 addr, uint32 count, bool write)
+			{
+				checkEnabled();
+				if (write)
+					checkWritable();
+				if (uint64(addr) + count > data.size())
+					CAGE_THROW_ERROR(Exception, "memory address out of bounds");
+				return { data.data() + addr, data.data() + addr + count };
+			}
 		};
 
 		struct Callstack
 		{
-			std::vector<uint32> data;
+			std::vector<uint32> data; // preallocated
+			uint32 size = 0;
 			uint32 capacity = 0;
 		};
 
@@ -249,34 +278,7 @@ namespace qasm
 
 		bool ioCharValid(uint32 c)
 		{
-			if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9'))
-				return true;
-
-			switch (c)
-			{
-			case ' ':
-			case '-':
-			case '+':
-			case '.':
-			case '_':
-			case '@':
-			case '#':
-			case '*':
-			case '/':
-			case ',':
-			case '(':
-			case ')':
-			case '<':
-			case '>':
-			case '=':
-			case '?':
-			case '!':
-			case ':':
-			case ';':
-				return true;
-			}
-
-			return false;
+			return isValidCharacter(c, CharacterClassEnum::Text);
 		}
 
 		bool ioCharWhite(uint32 c)
@@ -286,13 +288,7 @@ namespace qasm
 
 		string ioFilter(const string &str)
 		{
-			string r;
-			for (const char c : str)
-			{
-				if (ioCharValid(c))
-					r += string(c);
-			}
-			return r;
+			return filterCharacters(str);
 		}
 
 		struct IoBuffer
@@ -303,41 +299,52 @@ namespace qasm
 			static constexpr uint32 capacity = 100;
 			static_assert(capacity < string::MaxLength);
 
-			IoStat rstat() const
+			// the word is parsed only for the registers that are requested
+			IoStat rstat(uint64 registers = implicitRegisters("uif")) const
 			{
 				CAGE_ASSERT(buffer == ioFilter(buffer));
 				IoStat s;
 				s.size = buffer.size();
 				s.position = position;
+				if (registers & implicitRegisters("uif"))
 				{
 					const string w = peekWord();
 					detail::OverrideException oe;
-					try
-					{
-						toUint32(w);
-						s.u = true;
-					}
-					catch (...)
-					{
-						s.u = false;
-					}
-					try
-					{
-						toSint32(w);
-						s.i = true;
-					}
-					catch (...)
+					if (registers & implicitRegisters("u"))
 					{
-						s.i = false;
+						try
+						{
+							toUint32(w);
+							s.u = true;
+						}
+						catch (...)
+						{
+							s.u = false;
+						}
 					}
-					try
+					if (registers & implicitRegisters("i"))
 					{
-						toFloat(w);
-						s.f = true;
+						try
+						{
+							toSint32(w);
+							s.i = true;
+						}
+						catch (...)
+						{
+							s.i = false;
+						}
 					}
-					catch (...)
+					if (registers & implicitRegisters("f"))
 					{
-						s.f = false;
+						try
+						{
+							toFloat(w);
+							s.f = true;
+						}
+						catch (...)
+						{
+							s.f = false;
+						}
 					}
 				}
 				s.c = position < buffer.size();
@@ -389,6 +396,18 @@ namespace qasm
 				return toFloat(getWord());
 			}
 
+			string nextWord()
+			{
+				while (position < buffer.size() && ioCharWhite(buffer[position]))
+					position++;
+				uint32 end = position;
+				while (end < buffer.size() && !ioCharWhite(buffer[end]))
+					end++;
+				string w = subString(buffer, position, end - position);
+				position = end;
+				return w;
+			}
+
 			uint32 cread()
 			{
 				if (position >= buffer.size())
@@ -446,7 +465,9 @@ namespace qasm
 			Callstack callstack_;
 			IoBuffer inputBuffer, outputBuffer;
 			uint32 programCounter = 0; // index of current instruction in the program
+			bool jumped = false; // the current instruction transferred control to its target
 			uint64 stepIndex_ = 0;
+			uint64 interruptIndex = 0; // step index of the next periodic interrupt
 		};
 	}
 
@@ -456,6 +477,12 @@ namespace qasm
 
 		CpuStateEnum state = CpuStateEnum::None;
 		const ProgramImpl *binary = nullptr;
+		std::vector<InstructionEnum> instructions; // as verified for the limits of this cpu
+		uint32 memoriesUsed = 0; // bit mask of memory pools allocated on initialization
+		uint32 callstackSize = 0; // entries allocated on initialization
+		std::vector<LoopGuard> loopGuards;
+		std::vector<uint64> statRegisters; // see VerifiedProgram
+		bool running = false; // inside run, single steps must behave exactly as the original instructions (eg. never skip whole loops)
 
 		CpuImpl(const CpuCreateConfig &config) : config(config)
 		{}
@@ -479,11 +506,16 @@ namespace qasm
 					tapes[i].data.resize(1, 0);
 				if (memories[i].enabled)
 				{
-					memories[i].data.resize(config.limits.memoryCapacity[i], 0);
 					memories[i].readOnly = config.limits.memoryReadOnly[i];
+					if (memoriesUsed & (1u << i))
+						memories[i].allocate();
 				}
 			}
+			for (const MemoryDataRecord &d : binary->memoryData)
+				detail::memcpy(memories[d.pool].data.data() + d.address, binary->memoryDataValues.data() + d.offset, d.count * sizeof(uint32));
 			callstack_.capacity = config.limits.callstackCapacity;
+			callstack_.data.resize(callstackSize);
+			interruptIndex = config.interruptPeriod;
 			state = CpuStateEnum::Initialized;
 		}
 
@@ -547,39 +579,292 @@ namespace qasm
 			set('p' - 'a' + 26, stat.position);
 		}
 
+		// writes only the listed registers
+		// registers written by the verified stat instruction, all of them when single stepping
+		uint64 liveStatRegisters(uint32 pc) const
+		{
+			return running ? statRegisters[pc] : uint64(m);
+		}
+
+		void set(const StructureStat &stat, uint64 registers)
+		{
+			const auto &live = [&](char name) { return (registers & (uint64(1) << implicitRegister(name))) != 0; };
+			if (live('e'))
+				set('e' - 'a' + 26, stat.enabled);
+			if (live('a'))
+				set('a' - 'a' + 26, stat.size > 0);
+			if (live('f'))
+				set('f' - 'a' + 26, stat.size == stat.capacity);
+			if (live('w'))
+				set('w' - 'a' + 26, stat.writable);
+			if (live('c'))
+				set('c' - 'a' + 26, stat.capacity);
+			if (live('s'))
+				set('s' - 'a' + 26, stat.size);
+			if (live('p'))
+				iset('p' - 'a' + 26, stat.position);
+			if (live('l'))
+				iset('l' - 'a' + 26, stat.leftmost);
+			if (live('r'))
+				iset('r' - 'a' + 26, stat.rightmost);
+		}
+
+		void set(const IoStat &stat, uint64 registers)
+		{
+			const auto &live = [&](char name) { return (registers & (uint64(1) << implicitRegister(name))) != 0; };
+			if (live('u'))
+				set('u' - 'a' + 26, stat.u);
+			if (live('i'))
+				set('i' - 'a' + 26, stat.i);
+			if (live('f'))
+				set('f' - 'a' + 26, stat.f);
+			if (live('c'))
+				set('c' - 'a' + 26, stat.c);
+			if (live('w'))
+				set('w' - 'a' + 26, stat.w);
+			if (live('s'))
+				set('s' - 'a' + 26, stat.size);
+			if (live('p'))
+				set('p' - 'a' + 26, stat.position);
+		}
+
+		void bulkStore(uint8 type, uint8 index, uint32 offset, uint32 value)
+		{
+			if (type == 3)
+				memories[index].store(get('i' - 'a' + 26) + offset, value);
+			else
+				queues[index].enqueue(value);
+		}
+
+		// parses all remaining words in the input buffer, and optionally all remaining lines, into queue or memory pool
+		void bulkRead(Deserializer &params, InstructionEnum type, bool lines)
+		{
+			uint8 t, index;
+			params >> t >> index;
+			uint32 count = 0;
+			while (true)
+			{
+				while (true)
+				{
+					const string w = inputBuffer.nextWord();
+					if (w.empty())
+						break;
+					uint32 v = 0;
+					switch (type)
+					{
+					case InstructionEnum::readall: v = toUint32(w); break;
+					case InstructionEnum::ireadall: { sint32 k = toSint32(w); v = *(uint32 *)&k; } break;
+					case InstructionEnum::freadall: { real k = toFloat(w); v = *(uint32 *)&k; } break;
+					default: CAGE_THROW_CRITICAL(Exception, "invalid bulk read type");
+					}
+					bulkStore(t, index, count++, v);
+				}
+				if (!lines)
+					break;
+				string l;
+				if (!config.input || !config.input(l))
+					break;
+				inputBuffer.reset();
+				inputBuffer.buffer = ioFilter(l);
+			}
+			set('n' - 'a' + 26, count);
+			stepIndex_ += count;
+		}
+
+		// writes n elements from memory pool, starting at address i, as one line
+		void bulkWrite(Deserializer &params, InstructionEnum type)
+		{
+			uint8 index;
+			params >> index;
+			const uint32 start = get('i' - 'a' + 26);
+			const uint32 count = get('n' - 'a' + 26);
+			string l;
+			for (uint32 a = 0; a < count; a++)
+			{
+				const uint32 v = memories[index].load(start + a);
+				if (l.length() + 20 > string::MaxLength)
+					CAGE_THROW_ERROR(Exception, "write out of bounds");
+				if (a > 0)
+					l += string(" ");
+				switch (type)
+				{
+				case InstructionEnum::writeall: l += string(stringizer() + v); break;
+				case InstructionEnum::iwriteall: l += string(stringizer() + *(sint32 *)&v); break;
+				case InstructionEnum::fwriteall: l += string(stringizer() + *(real *)&v); break;
+				default: CAGE_THROW_CRITICAL(Exception, "invalid bulk write type");
+				}
+			}
+			set('z' - 'a' + 26, config.output && config.output(l));
+			stepIndex_ += count;
+		}
+
 		void jump(uint32 position)
 		{
 			programCounter = position;
+			jumped = true;
 		}
 
 		void fncCall(uint32 position)
 		{
-			if (callstack_.data.size() >= callstack_.capacity)
+			if (callstack_.size >= callstack_.capacity)
 				CAGE_THROW_ERROR(Exception, "stack overflow");
-			callstack_.data.push_back(programCounter);
+			verifiedCall(position);
+		}
+
+		// the verifier proved that the callstack cannot overflow
+		void verifiedCall(uint32 position)
+		{
+			CAGE_ASSERT(callstack_.size < callstack_.data.size());
+			callstack_.data[callstack_.size++] = programCounter;
 			programCounter = position;
+			jumped = true;
 		}
 
 		void fncReturn()
 		{
-			if (callstack_.data.empty())
+			if (callstack_.size == 0)
 				CAGE_THROW_ERROR(Exception, "no function to return from");
-			programCounter = callstack_.data.back();
-			callstack_.data.pop_back();
+			verifiedReturn();
+		}
+
+		// the verifier proved that returns are executed inside functions only
+		void verifiedReturn()
+		{
+			CAGE_ASSERT(callstack_.size > 0);
+			programCounter = callstack_.data[--callstack_.size];
+		}
+
+		// the accesses in the loop skip the checks if all addresses that the loop will use are valid
+		// otherwise the checked forms fail exactly where they would without the guard
+		void loopGuard(uint32 pc)
+		{
+			const auto it = std::lower_bound(loopGuards.begin(), loopGuards.end(), pc, [](const LoopGuard &g, uint32 pc) { return g.instruction < pc; });
+			CAGE_ASSERT(it != loopGuards.end() && it->instruction == pc);
+			const uint32 limit = it->limitRegister == m ? it->limit : get(it->limitRegister);
+			bool safe = it->start < limit;
+			for (const LoopAccess &a : it->accesses)
+			{
+				const uint32 base = a.baseRegister == m ? a.base : get(a.baseRegister);
+				safe = safe && uint64(base) + limit - 1 + a.offset < memories[a.pool].data.size();
+			}
+			for (const LoopAccess &a : it->accesses)
+			{
+				if (a.store)
+					instructions[a.instruction] = safe ? InstructionEnum::vindstore : InstructionEnum::indstore;
+				else
+					instructions[a.instruction] = safe ? InstructionEnum::vindload : InstructionEnum::indload;
+			}
+			if (safe && running && it->kernel.type != LoopKernelEnum::None)
+			{
+				// periodic interrupts must stop the loop at the same instructions
+				const uint32 count = limit - it->start;
+				if (stepIndex_ + uint64(count) * it->kernel.steps + uint64(count - 1) * it->kernel.jumpSteps < interruptIndex)
+					loopKernel(*it, limit);
+			}
+		}
+
+		// executes whole loop at once, leaving the same registers, memory and step index as the individual instructions would
+		void loopKernel(const LoopGuard &g, uint32 limit)
+		{
+			const LoopKernel &k = g.kernel;
+			const uint32 count = limit - g.start;
+			const auto &address = [&](const LoopAccess &a) -> uint32 {
+				return (a.baseRegister == m ? a.base : get(a.baseRegister)) + g.start + a.offset;
+			};
+			const LoopAccess &first = g.accesses[0];
+			uint32 *data = memories[first.pool].data.data() + address(first);
+			switch (k.type)
+			{
+			case LoopKernelEnum::Fill:
+			{
+				std::fill(data, data + count, get(k.value));
+			} break;
+			case LoopKernelEnum::Reduce:
+			{
+				uint32 acc = get(k.accumulator);
+				switch (k.operation)
+				{
+				case InstructionEnum::add:
+				case InstructionEnum::iadd:
+					for (uint32 j = 0; j < count; j++)
+						acc += data[j];
+					break;
+				case InstructionEnum::mul:
+				case InstructionEnum::imul:
+					for (uint32 j = 0; j < count; j++)
+						acc *= data[j];
+					break;
+				case InstructionEnum::band:
+					for (uint32 j = 0; j < count; j++)
+						acc &= data[j];
+					break;
+				case InstructionEnum::bor:
+					for (uint32 j = 0; j < count; j++)
+						acc |= data[j];
+					break;
+				case InstructionEnum::bxor:
+					for (uint32 j = 0; j < count; j++)
+						acc ^= data[j];
+					break;
+				case InstructionEnum::fadd:
+				{
+					real f = *(real *)&acc;
+					for (uint32 j = 0; j < count; j++)
+						f = f + *(const real *)&data[j];
+					acc = *(uint32 *)&f;
+				} break;
+				case InstructionEnum::fmul:
+				{
+					real f = *(real *)&acc;
+					for (uint32 j = 0; j < count; j++)
+						f = f * *(const real *)&data[j];
+					acc = *(uint32 *)&f;
+				} break;
+				default:
+					CAGE_THROW_CRITICAL(Exception, "invalid loop kernel operation");
+				}
+				set(k.accumulator, acc);
+				set(k.value, data[count - 1]);
+			} break;
+			case LoopKernelEnum::Copy:
+			{
+				const LoopAccess &second = g.accesses[1];
+				uint32 *target = memories[second.pool].data.data() + address(second);
+				set(k.value, data[count - 1]);
+				if (first.pool != second.pool || target + count <= data || data + count <= target)
+					std::copy(data, data + count, target);
+				else
+				{
+					// overlapping ranges, the values stored in earlier iterations may be loaded again
+					for (uint32 j = 0; j < count; j++)
+						target[j] = data[j];
+					set(k.value, target[count - 1]);
+				}
+			} break;
+			default:
+				CAGE_THROW_CRITICAL(Exception, "invalid loop kernel");
+			}
+			set('i' - 'a' + 26, address(g.accesses.back()) + count - 1);
+			set('z' - 'a' + 26, 0);
+			set(k.counter, limit);
+			stepIndex_ += uint64(count) * k.steps + uint64(count - 1) * k.jumpSteps;
+			programCounter = k.exit;
 		}
 
 		void step()
 		{
 			CAGE_ASSERT(state == CpuStateEnum::Running);
-			if ((++stepIndex_ % config.interruptPeriod) == 0)
+			if (++stepIndex_ >= interruptIndex)
 			{
+				// bulk instructions and step weights may skip over multiples of the period
+				interruptIndex = (stepIndex_ / config.interruptPeriod + 1) * config.interruptPeriod;
 				state = CpuStateEnum::Interrupted;
 				return;
 			}
 			const uint32 pc = programCounter++;
 			Deserializer params = Deserializer(binary->params);
 			params.advance(binary->paramsOffsets[pc]);
-			switch (binary->instructions[pc])
+			switch (instructions[pc])
 			{
 			case InstructionEnum::nop:
 				break;
@@ -595,6 +880,13 @@ namespace qasm
 				params >> r >> v;
 				set(r, v);
 			} break;
+			case InstructionEnum::vguard:
+			{
+				uint8 r; uint32 v;
+				params >> r >> v;
+				set(r, v);
+				loopGuard(pc);
+			} break;
 			case InstructionEnum::iset:
 			{
 				uint8 r; sint32 v;
@@ -1168,6 +1460,12 @@ namespace qasm
 				params >> s;
 				set(stacks[s].stat());
 			} break;
+			case InstructionEnum::vsstat:
+			{
+				uint8 s;
+				params >> s;
+				set(stacks[s].stat(), liveStatRegisters(pc));
+			} break;
 			case InstructionEnum::indsstat:
 			{
 				uint8 s = get('i' - 'a' + 26);
@@ -1219,6 +1517,12 @@ namespace qasm
 				params >> s;
 				set(queues[s].stat());
 			} break;
+			case InstructionEnum::vqstat:
+			{
+				uint8 s;
+				params >> s;
+				set(queues[s].stat(), liveStatRegisters(pc));
+			} break;
 			case InstructionEnum::indqstat:
 			{
 				uint8 s = get('i' - 'a' + 26);
@@ -1276,6 +1580,12 @@ namespace qasm
 				params >> s;
 				set(tapes[s].stat());
 			} break;
+			case InstructionEnum::vtstat:
+			{
+				uint8 s;
+				params >> s;
+				set(tapes[s].stat(), liveStatRegisters(pc));
+			} break;
 			case InstructionEnum::indtstat:
 			{
 				uint8 s = get('i' - 'a' + 26);
@@ -1289,6 +1599,12 @@ namespace qasm
 				params >> d >> s >> a;
 				set(d, memories[s].load(a));
 			} break;
+			case InstructionEnum::vmload:
+			{
+				uint8 d, s; uint32 a;
+				params >> d >> s >> a;
+				set(d, memories[s].data[a]);
+			} break;
 			case InstructionEnum::indload:
 			{
 				uint8 d, s;
@@ -1296,6 +1612,12 @@ namespace qasm
 				uint32 a = get('i' - 'a' + 26);
 				set(d, memories[s].load(a));
 			} break;
+			case InstructionEnum::vindload:
+			{
+				uint8 d, s;
+				params >> d >> s;
+				set(d, memories[s].data[get('i' - 'a' + 26)]);
+			} break;
 			case InstructionEnum::indindload:
 			{
 				uint8 d;
@@ -1312,6 +1634,12 @@ namespace qasm
 				params >> d >> a >> s;
 				memories[d].store(a, get(s));
 			} break;
+			case InstructionEnum::vmstore:
+			{
+				uint8 d, s; uint32 a;
+				params >> d >> a >> s;
+				memories[d].data[a] = get(s);
+			} break;
 			case InstructionEnum::indstore:
 			{
 				uint8 d, s;
@@ -1319,6 +1647,12 @@ namespace qasm
 				uint32 a = get('i' - 'a' + 26);
 				memories[d].store(a, get(s));
 			} break;
+			case InstructionEnum::vindstore:
+			{
+				uint8 d, s;
+				params >> d >> s;
+				memories[d].data[get('i' - 'a' + 26)] = get(s);
+			} break;
 			case InstructionEnum::indindstore:
 			{
 				uint8 s;
@@ -1349,6 +1683,12 @@ namespace qasm
 				params >> s;
 				set(memories[s].stat());
 			} break;
+			case InstructionEnum::vmstat:
+			{
+				uint8 s;
+				params >> s;
+				set(memories[s].stat(), liveStatRegisters(pc));
+			} break;
 			case InstructionEnum::indmstat:
 			{
 				uint8 s = get('i' - 'a' + 26);
@@ -1386,6 +1726,21 @@ namespace qasm
 					fncCall(pos);
 				}
 			} break;
+			case InstructionEnum::vcall:
+			{
+				uint32 pos;
+				params >> pos;
+				verifiedCall(pos);
+			} break;
+			case InstructionEnum::vcondcall:
+			{
+				if (get('z' - 'a' + 26) != 0)
+				{
+					uint32 pos;
+					params >> pos;
+					verifiedCall(pos);
+				}
+			} break;
 			case InstructionEnum::return_:
 			{
 				fncReturn();
@@ -1395,10 +1750,24 @@ namespace qasm
 				if (get('z' - 'a' + 26) != 0)
 					fncReturn();
 			} break;
+			case InstructionEnum::vreturn:
+			{
+				verifiedReturn();
+			} break;
+			case InstructionEnum::vcondreturn:
+			{
+				if (get('z' - 'a' + 26) != 0)
+					verifiedReturn();
+			} break;
 			case InstructionEnum::rstat:
 			{
 				set(inputBuffer.rstat());
 			} break;
+			case InstructionEnum::vrstat:
+			{
+				const uint64 registers = liveStatRegisters(pc);
+				set(inputBuffer.rstat(registers), registers);
+			} break;
 			case InstructionEnum::wstat:
 			{
 				set(inputBuffer.wstat());
@@ -1502,6 +1871,67 @@ namespace qasm
 				CAGE_ASSERT(outputBuffer.buffer == ioFilter(outputBuffer.buffer));
 				std::swap(inputBuffer, outputBuffer);
 			} break;
+			case InstructionEnum::readall:
+				bulkRead(params, InstructionEnum::readall, false);
+				break;
+			case InstructionEnum::ireadall:
+				bulkRead(params, InstructionEnum::ireadall, false);
+				break;
+			case InstructionEnum::freadall:
+				bulkRead(params, InstructionEnum::freadall, false);
+				break;
+			case InstructionEnum::readlns:
+				bulkRead(params, InstructionEnum::readall, true);
+				break;
+			case InstructionEnum::ireadlns:
+				bulkRead(params, InstructionEnum::ireadall, true);
+				break;
+			case InstructionEnum::freadlns:
+				bulkRead(params, InstructionEnum::freadall, true);
+				break;
+			case InstructionEnum::writeall:
+			case InstructionEnum::iwriteall:
+			case InstructionEnum::fwriteall:
+				bulkWrite(params, instructions[pc]);
+				break;
+			case InstructionEnum::bread:
+			{
+				uint8 d;
+				params >> d;
+				uint32 v = 0;
+				const bool ok = config.binaryInput && config.binaryInput({ &v, &v + 1 }) == 1;
+				if (ok)
+					set(d, v);
+				set('z' - 'a' + 26, ok);
+			} break;
+			case InstructionEnum::bwrite:
+			{
+				uint8 s;
+				params >> s;
+				const uint32 v = get(s);
+				set('z' - 'a' + 26, config.binaryOutput && config.binaryOutput({ &v, &v + 1 }));
+			} break;
+			case InstructionEnum::bmread:
+			{
+				uint8 s;
+				params >> s;
+				const uint32 requested = get('n' - 'a' + 26);
+				PointerRange<uint32> r = memories[s].range(get('i' - 'a' + 26), requested, true);
+				const uint32 count = config.binaryInput ? config.binaryInput(r) : 0;
+				CAGE_ASSERT(count <= requested);
+				set('n' - 'a' + 26, count);
+				set('z' - 'a' + 26, count == requested);
+				stepIndex_ += count;
+			} break;
+			case InstructionEnum::bmwrite:
+			{
+				uint8 s;
+				params >> s;
+				const uint32 count = get('n' - 'a' + 26);
+				PointerRange<const uint32> r = memories[s].range(get('i' - 'a' + 26), count, false);
+				set('z' - 'a' + 26, config.binaryOutput && config.binaryOutput(r));
+				stepIndex_ += count;
+			} break;
 			case InstructionEnum::rand:
 			{
 				uint8 d;
@@ -1520,6 +1950,11 @@ namespace qasm
 				params >> d;
 				fset(d, detail::getApplicationRandomGenerator().randomChance());
 			} break;
+#define QASM_IMMEDIATE_CASE(NAME) case InstructionEnum::NAME##imm: { uint8 d, l; uint32 v; params >> d >> l >> v; set(d, evaluateBinary(InstructionEnum::NAME, get(l), v)); } break;
+			CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(QASM_IMMEDIATE_CASE, QASM_IMMEDIATE_INSTRUCTIONS_1))
+			CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(QASM_IMMEDIATE_CASE, QASM_IMMEDIATE_INSTRUCTIONS_2))
+			CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(QASM_IMMEDIATE_CASE, QASM_IMMEDIATE_INSTRUCTIONS_3))
+#undef QASM_IMMEDIATE_CASE
 			case InstructionEnum::profiling:
 			case InstructionEnum::tracing:
 				CAGE_THROW_ERROR(NotImplemented, "not yet implemented instruction");
@@ -1529,6 +1964,7 @@ namespace qasm
 				break;
 			case InstructionEnum::exit:
 				state = CpuStateEnum::Finished;
+				programCounter = pc; // stay on the exit instruction
 				break;
 			case InstructionEnum::terminate:
 				CAGE_THROW_ERROR(Exception, "explicit terminate");
@@ -1543,6 +1979,12 @@ namespace qasm
 				CAGE_THROW_ERROR(Exception, "unknown instruction");
 				break;
 			}
+			if (!binary->stepWeights.empty())
+			{
+				const StepWeight &w = binary->stepWeights[pc];
+				stepIndex_ += w.steps + (jumped ? w.jumpSteps : 0);
+			}
+			jumped = false;
 		}
 	};
 
@@ -1554,6 +1996,12 @@ namespace qasm
 	void Cpu::program(const Program *binary)
 	{
 		CpuImpl *impl = (CpuImpl *)this;
+		VerifiedProgram verified = binary ? programVerify((const ProgramImpl *)binary, impl->config.limits) : VerifiedProgram();
+		std::swap(impl->instructions, verified.instructions);
+		impl->memoriesUsed = verified.memoriesUsed;
+		impl->callstackSize = verified.callstackSize;
+		std::swap(impl->loopGuards, verified.loopGuards);
+		std::swap(impl->statRegisters, verified.statRegisters);
 		impl->binary = (const ProgramImpl *)binary;
 		if (binary)
 		{
@@ -1575,6 +2023,7 @@ namespace qasm
 		CpuImpl *impl = (CpuImpl *)this;
 		CAGE_ASSERT(impl->state == CpuStateEnum::Initialized || impl->state == CpuStateEnum::Running || impl->state == CpuStateEnum::Interrupted);
 		impl->state = CpuStateEnum::Running;
+		impl->running = true;
 		try
 		{
 			while (impl->state == CpuStateEnum::Running)
@@ -1582,9 +2031,12 @@ namespace qasm
 		}
 		catch (...)
 		{
+			impl->running = false;
 			impl->state = CpuStateEnum::Terminated;
+			impl->programCounter--; // report the failed instruction
 			throw;
 		}
+		impl->running = false;
 	}
 
 	void Cpu::step()
@@ -1599,6 +2051,7 @@ namespace qasm
 		catch (...)
 		{
 			impl->state = CpuStateEnum::Terminated;
+			impl->programCounter--; // report the failed instruction
 			throw;
 		}
 	}
@@ -1672,8 +2125,9 @@ namespace qasm
 
 	PointerRange<const uint32> Cpu::memory(uint32 index) const
 	{
-		const CpuImpl *impl = (const CpuImpl *)this;
+		CpuImpl *impl = (CpuImpl *)this;
 		CAGE_ASSERT(index < 26);
+		impl->memories[index].allocate();
 		return impl->memories[index].data;
 	}
 
@@ -1681,6 +2135,7 @@ namespace qasm
 	{
 		CpuImpl *impl = (CpuImpl *)this;
 		CAGE_ASSERT(index < 26);
+		impl->memories[index].allocate();
 		if (impl->memories[index].data.size() < data.size())
 			CAGE_THROW_ERROR(Exception, "insufficient memory pool size");
 		detail::memcpy(impl->memories[index].data.data(), data.data(), data.size() * sizeof(uint32));
@@ -1689,7 +2144,7 @@ namespace qasm
 	PointerRange<const uint32> Cpu::callstack() const
 	{
 		CpuImpl *impl = (CpuImpl *)this;
-		return impl->callstack_.data;
+		return { impl->callstack_.data.data(), impl->callstack_.data.data() + impl->callstack_.size };
 	}
 
 	uint32 Cpu::functionIndex() const
@@ -0,0 +1,511 @@
+#include "instructions.h"
+
+#include <limits>
+
+namespace qasm
+{
+	namespace
+	{
+		constexpr uint64 StructureStatRegisters = implicitRegisters("eafwcsplr");
+		constexpr uint64 IoStatRegisters = implicitRegisters("uifcwsp");
+
+		InstructionInfo info(const char *operands, uint64 reads = 0, uint64 writes = 0)
+		{
+			InstructionInfo r;
+			r.operands = operands;
+			r.implicitReads = reads;
+			r.implicitWrites = writes;
+			return r;
+		}
+	}
+
+	InstructionInfo instructionInfo(InstructionEnum instruction)
+	{
+		switch (instruction)
+		{
+		case InstructionEnum::nop: return info("");
+
+		// register
+		case InstructionEnum::reset: return info("d");
+		case InstructionEnum::set: return info("du");
+		case InstructionEnum::iset: return info("di");
+		case InstructionEnum::fset: return info("df");
+		case InstructionEnum::copy: return info("dr");
+		case InstructionEnum::condrst: return info("c", implicitRegisters("z"));
+		case InstructionEnum::condset: return info("cu", implicitRegisters("z"));
+		case InstructionEnum::condiset: return info("ci", implicitRegisters("z"));
+		case InstructionEnum::condfset: return info("cf", implicitRegisters("z"));
+		case InstructionEnum::condcpy: return info("cr", implicitRegisters("z"));
+		case InstructionEnum::indcpy:
+		{
+			InstructionInfo r = info("", implicitRegisters("ds"));
+			r.writesAnyRegister = true;
+			return r;
+		}
+
+		// arithmetic
+		case InstructionEnum::add:
+		case InstructionEnum::sub:
+		case InstructionEnum::mul:
+		case InstructionEnum::div:
+		case InstructionEnum::mod:
+		case InstructionEnum::iadd:
+		case InstructionEnum::isub:
+		case InstructionEnum::imul:
+		case InstructionEnum::idiv:
+		case InstructionEnum::imod:
+		case InstructionEnum::fadd:
+		case InstructionEnum::fsub:
+		case InstructionEnum::fmul:
+		case InstructionEnum::fdiv:
+		case InstructionEnum::fpow:
+		case InstructionEnum::fatan2:
+			return info("drr");
+		case InstructionEnum::inc:
+		case InstructionEnum::dec:
+		case InstructionEnum::iinc:
+		case InstructionEnum::idec:
+			return info("x");
+		case InstructionEnum::iabs: return info("xr"); // the second register is not used by the cpu
+		case InstructionEnum::fabs:
+		case InstructionEnum::fsqrt:
+		case InstructionEnum::flog:
+		case InstructionEnum::fsin:
+		case InstructionEnum::fcos:
+		case InstructionEnum::ftan:
+		case InstructionEnum::fasin:
+		case InstructionEnum::facos:
+		case InstructionEnum::fatan:
+		case InstructionEnum::ffloor:
+		case InstructionEnum::fround:
+		case InstructionEnum::fceil:
+		case InstructionEnum::s2f:
+		case InstructionEnum::u2f:
+		case InstructionEnum::f2s:
+		case InstructionEnum::f2u:
+			return info("dr");
+
+		// logic
+		case InstructionEnum::and_:
+		case InstructionEnum::or_:
+		case InstructionEnum::xor_:
+		case InstructionEnum::shl:
+		case InstructionEnum::shr:
+		case InstructionEnum::rol:
+		case InstructionEnum::ror:
+		case InstructionEnum::band:
+		case InstructionEnum::bor:
+		case InstructionEnum::bxor:
+			return info("drr");
+		case InstructionEnum::not_:
+		case InstructionEnum::bnot:
+			return info("dr");
+		case InstructionEnum::inv:
+		case InstructionEnum::binv:
+			return info("x");
+
+		// comparisons
+		case InstructionEnum::eq:
+		case InstructionEnum::neq:
+		case InstructionEnum::lt:
+		case InstructionEnum::gt:
+		case InstructionEnum::lte:
+		case InstructionEnum::gte:
+		case InstructionEnum::ieq:
+		case InstructionEnum::ineq:
+		case InstructionEnum::ilt:
+		case InstructionEnum::igt:
+		case InstructionEnum::ilte:
+		case InstructionEnum::igte:
+		case InstructionEnum::feq:
+		case InstructionEnum::fneq:
+		case InstructionEnum::flt:
+		case InstructionEnum::fgt:
+		case InstructionEnum::flte:
+		case InstructionEnum::fgte:
+			return info("drr");
+		case InstructionEnum::fisnan:
+		case InstructionEnum::fisinf:
+		case InstructionEnum::fisfin:
+		case InstructionEnum::fisnorm:
+		case InstructionEnum::test:
+			return info("dr");
+
+		// stack
+		case InstructionEnum::sload: return info("dS");
+		case InstructionEnum::sstore: return info("Sr");
+		case InstructionEnum::pop: return info("dS");
+		case InstructionEnum::push: return info("Sr");
+		case InstructionEnum::sswap: return info("SS");
+		case InstructionEnum::indsswap: return info("", implicitRegisters("ij"));
+		case InstructionEnum::sstat: return info("S", 0, StructureStatRegisters);
+		case InstructionEnum::indsstat: return info("", implicitRegisters("i"), StructureStatRegisters);
+
+		// queue
+		case InstructionEnum::qload: return info("dQ");
+		case InstructionEnum::qstore: return info("Qr");
+		case InstructionEnum::dequeue: return info("dQ");
+		case InstructionEnum::enqueue: return info("Qr");
+		case InstructionEnum::qswap: return info("QQ");
+		case InstructionEnum::indqswap: return info("", implicitRegisters("ij"));
+		case InstructionEnum::qstat: return info("Q", 0, StructureStatRegisters);
+		case InstructionEnum::indqstat: return info("", implicitRegisters("i"), StructureStatRegisters);
+
+		// tape
+		case InstructionEnum::tload: return info("dT");
+		case InstructionEnum::tstore: return info("Tr");
+		case InstructionEnum::left:
+		case InstructionEnum::right:
+		case InstructionEnum::center:
+			return info("T");
+		case InstructionEnum::tswap: return info("TT");
+		case InstructionEnum::indtswap: return info("", implicitRegisters("ij"));
+		case InstructionEnum::tstat: return info("T", 0, StructureStatRegisters);
+		case InstructionEnum::indtstat: return info("", implicitRegisters("i"), StructureStatRegisters);
+
+		// memory
+		case InstructionEnum::mload: return info("dMu");
+		case InstructionEnum::indload: return info("dM", implicitRegisters("i"));
+		case InstructionEnum::indindload: return info("d", implicitRegisters("ij"));
+		case InstructionEnum::mstore: return info("Mur");
+		case InstructionEnum::indstore: return info("Mr", implicitRegisters("i"));
+		case InstructionEnum::indindstore: return info("r", implicitRegisters("ij"));
+		case InstructionEnum::mswap: return info("MM");
+		case InstructionEnum::indmswap: return info("", implicitRegisters("ij"));
+		case InstructionEnum::mstat: return info("M", 0, StructureStatRegisters);
+		case InstructionEnum::indmstat: return info("", implicitRegisters("i"), StructureStatRegisters);
+
+		// jumps
+		case InstructionEnum::jump: return info("l");
+		case InstructionEnum::condjmp: return info("l", implicitRegisters("z"));
+
+		// functions
+		case InstructionEnum::call: return info("l");
+		case InstructionEnum::condcall: return info("l", implicitRegisters("z"));
+		case InstructionEnum::return_: return info("");
+		case InstructionEnum::condreturn: return info("", implicitRegisters("z"));
+
+		// input/output
+		case InstructionEnum::rstat:
+		case InstructionEnum::wstat:
+			return info("", 0, IoStatRegisters);
+		case InstructionEnum::read:
+		case InstructionEnum::iread:
+		case InstructionEnum::fread:
+		case InstructionEnum::cread:
+			return info("d");
+		case InstructionEnum::readln: return info("", 0, implicitRegisters("fz"));
+		case InstructionEnum::rreset:
+		case InstructionEnum::rclear:
+			return info("");
+		case InstructionEnum::write:
+		case InstructionEnum::iwrite:
+		case InstructionEnum::fwrite:
+		case InstructionEnum::cwrite:
+			return info("r");
+		case InstructionEnum::writeln: return info("", 0, implicitRegisters("z"));
+		case InstructionEnum::wreset:
+		case InstructionEnum::wclear:
+		case InstructionEnum::rwswap:
+			return info("");
+		case InstructionEnum::readall:
+		case InstructionEnum::ireadall:
+		case InstructionEnum::freadall:
+		case InstructionEnum::readlns:
+		case InstructionEnum::ireadlns:
+		case InstructionEnum::freadlns:
+			return info("yk", implicitRegisters("i"), implicitRegisters("n"));
+		case InstructionEnum::writeall:
+		case InstructionEnum::iwriteall:
+		case InstructionEnum::fwriteall:
+			return info("M", implicitRegisters("in"), implicitRegisters("z"));
+		case InstructionEnum::bread: return info("c", 0, implicitRegisters("z"));
+		case InstructionEnum::bwrite: return info("r", 0, implicitRegisters("z"));
+		case InstructionEnum::bmread: return info("M", implicitRegisters("in"), implicitRegisters("nz"));
+		case InstructionEnum::bmwrite: return info("M", implicitRegisters("in"), implicitRegisters("z"));
+
+		// random
+		case InstructionEnum::rand:
+		case InstructionEnum::irand:
+		case InstructionEnum::frand:
+			return info("d");
+
+		// immediate operand forms
+#define QASM_IMMEDIATE_CASE(NAME) case InstructionEnum::NAME##imm:
+		CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(QASM_IMMEDIATE_CASE, QASM_IMMEDIATE_INSTRUCTIONS_1))
+		CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(QASM_IMMEDIATE_CASE, QASM_IMMEDIATE_INSTRUCTIONS_2))
+		CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(QASM_IMMEDIATE_CASE, QASM_IMMEDIATE_INSTRUCTIONS_3))
+#undef QASM_IMMEDIATE_CASE
+			return info("dru");
+
+		// verified forms
+		case InstructionEnum::vmload: return info("dMu");
+		case InstructionEnum::vmstore: return info("Mur");
+		case InstructionEnum::vcall: return info("l");
+		case InstructionEnum::vcondcall: return info("l", implicitRegisters("z"));
+		case InstructionEnum::vreturn: return info("");
+		case InstructionEnum::vcondreturn: return info("", implicitRegisters("z"));
+		case InstructionEnum::vguard: return info("du");
+		case InstructionEnum::vindload: return info("dM", implicitRegisters("i"));
+		case InstructionEnum::vindstore: return info("Mr", implicitRegisters("i"));
+		case InstructionEnum::vsstat: return info("S", 0, StructureStatRegisters);
+		case InstructionEnum::vqstat: return info("Q", 0, StructureStatRegisters);
+		case InstructionEnum::vtstat: return info("T", 0, StructureStatRegisters);
+		case InstructionEnum::vmstat: return info("M", 0, StructureStatRegisters);
+		case InstructionEnum::vrstat: return info("", 0, IoStatRegisters);
+
+		// miscellaneous
+		case InstructionEnum::profiling:
+		case InstructionEnum::tracing:
+			return info("b");
+		case InstructionEnum::breakpoint:
+		case InstructionEnum::exit:
+		case InstructionEnum::terminate:
+		case InstructionEnum::unreachable:
+		case InstructionEnum::disabled:
+			return info("");
+		}
+		CAGE_THROW_CRITICAL(Exception, "unknown instruction");
+	}
+
+	const char *instructionName(InstructionEnum instruction)
+	{
+		switch (instruction)
+		{
+#define QASM_NAME_CASE(NAME) case InstructionEnum::NAME: return CAGE_STRINGIZE(NAME);
+		CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(QASM_NAME_CASE, reset, set, iset, fset, copy, condrst, condset, condiset, condfset, condcpy, indcpy))
+		CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(QASM_NAME_CASE, add, sub, mul, div, mod, inc, dec, iadd, isub, imul, idiv, imod, iinc, idec, iabs))
+		CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(QASM_NAME_CASE, fadd, fsub, fmul, fdiv, fpow, fatan2, fabs, fsqrt, flog, fsin, fcos, ftan, fasin, facos, fatan, ffloor, fround, fceil))
+		CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(QASM_NAME_CASE, s2f, u2f, f2s, f2u, inv, shl, shr, rol, ror, band, bor, bxor, bnot, binv))
+		CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(QASM_NAME_CASE, eq, neq, lt, gt, lte, gte, ieq, ineq, ilt, igt, ilte, igte, feq, fneq, flt, fgt, flte, fgte))
+		CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(QASM_NAME_CASE, fisnan, fisinf, fisfin, fisnorm, test, pop, push, dequeue, enqueue, left, right, center))
+		CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(QASM_NAME_CASE, indload, indindload, indstore, indindstore, jump, condjmp, call, condcall, condreturn))
+		CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(QASM_NAME_CASE, rstat, wstat, read, iread, fread, cread, readln, rreset, rclear, write, iwrite, fwrite, cwrite, writeln, wreset, wclear, rwswap))
+		CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(QASM_NAME_CASE, readall, ireadall, freadall, readlns, ireadlns, freadlns, writeall, iwriteall, fwriteall, bread, bwrite))
+		CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(QASM_NAME_CASE, rand, irand, frand, profiling, tracing, breakpoint, terminate))
+#undef QASM_NAME_CASE
+#define QASM_IMMEDIATE_CASE(NAME) case InstructionEnum::NAME##imm: return CAGE_STRINGIZE(NAME);
+		CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(QASM_IMMEDIATE_CASE, QASM_IMMEDIATE_INSTRUCTIONS_1))
+		CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(QASM_IMMEDIATE_CASE, QASM_IMMEDIATE_INSTRUCTIONS_2))
+		CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(QASM_IMMEDIATE_CASE, QASM_IMMEDIATE_INSTRUCTIONS_3))
+#undef QASM_IMMEDIATE_CASE
+		case InstructionEnum::and_: return "and";
+		case InstructionEnum::or_: return "or";
+		case InstructionEnum::xor_: return "xor";
+		case InstructionEnum::not_: return "not";
+		case InstructionEnum::return_: return "return";
+		case InstructionEnum::sload:
+		case InstructionEnum::qload:
+		case InstructionEnum::tload:
+		case InstructionEnum::mload:
+		case InstructionEnum::vmload:
+			return "load";
+		case InstructionEnum::sstore:
+		case InstructionEnum::qstore:
+		case InstructionEnum::tstore:
+		case InstructionEnum::mstore:
+		case InstructionEnum::vmstore:
+			return "store";
+		case InstructionEnum::sswap:
+		case InstructionEnum::qswap:
+		case InstructionEnum::tswap:
+		case InstructionEnum::mswap:
+			return "swap";
+		case InstructionEnum::indsswap:
+		case InstructionEnum::indqswap:
+		case InstructionEnum::indtswap:
+		case InstructionEnum::indmswap:
+			return "indswap";
+		case InstructionEnum::sstat:
+		case InstructionEnum::qstat:
+		case InstructionEnum::tstat:
+		case InstructionEnum::mstat:
+		case InstructionEnum::vsstat:
+		case InstructionEnum::vqstat:
+		case InstructionEnum::vtstat:
+		case InstructionEnum::vmstat:
+			return "stat";
+		case InstructionEnum::indsstat:
+		case InstructionEnum::indqstat:
+		case InstructionEnum::indtstat:
+		case InstructionEnum::indmstat:
+			return "indstat";
+		case InstructionEnum::bmread: return "bread";
+		case InstructionEnum::bmwrite: return "bwrite";
+		case InstructionEnum::vcall: return "call";
+		case InstructionEnum::vcondcall: return "condcall";
+		case InstructionEnum::vreturn: return "return";
+		case InstructionEnum::vcondreturn: return "condreturn";
+		case InstructionEnum::vguard: return "set";
+		case InstructionEnum::vindload: return "indload";
+		case InstructionEnum::vindstore: return "indstore";
+		case InstructionEnum::vrstat: return "rstat";
+		default:
+			return nullptr;
+		}
+	}
+
+	const char *instructionCategory(InstructionEnum instruction)
+	{
+		const char *name = instructionName(instruction);
+		if (!name)
+			return nullptr;
+		switch (instruction)
+		{
+		case InstructionEnum::vguard:
+			return "registers";
+		case InstructionEnum::vmload:
+		case InstructionEnum::vmstore:
+		case InstructionEnum::vindload:
+		case InstructionEnum::vindstore:
+		case InstructionEnum::vsstat:
+		case InstructionEnum::vqstat:
+		case InstructionEnum::vtstat:
+		case InstructionEnum::vmstat:
+			return "structures";
+		case InstructionEnum::vrstat:
+			return "io";
+		case InstructionEnum::vcall:
+		case InstructionEnum::vcondcall:
+		case InstructionEnum::vreturn:
+		case InstructionEnum::vcondreturn:
+			return "functions";
+		default:
+			break;
+		}
+		if (instruction >= InstructionEnum::addimm && instruction <= InstructionEnum::fgteimm)
+		{
+			for (uint32 i = 0; i < uint32(InstructionEnum::addimm); i++)
+				if (immediateForm(InstructionEnum(i)) == instruction)
+					return instructionCategory(InstructionEnum(i));
+		}
+		if (instruction <= InstructionEnum::indcpy)
+			return "registers";
+		if (instruction <= InstructionEnum::f2u)
+			return "arithmetic";
+		if (instruction <= InstructionEnum::binv)
+			return "logic";
+		if (instruction <= InstructionEnum::test)
+			return "comparisons";
+		if (instruction <= InstructionEnum::indmstat)
+			return "structures";
+		if (instruction <= InstructionEnum::condjmp)
+			return "jumps";
+		if (instruction <= InstructionEnum::condreturn)
+			return "functions";
+		if (instruction <= InstructionEnum::bmwrite)
+			return "io";
+		if (instruction <= InstructionEnum::frand)
+			return "random";
+		return "miscellaneous";
+	}
+
+	std::bitset<InstructionsCount> instructionsMask(PointerRange<const string> names)
+	{
+		std::bitset<InstructionsCount> mask;
+		for (const string &n : names)
+		{
+			bool found = false;
+			for (uint32 i = 0; i < InstructionsCount; i++)
+			{
+				const InstructionEnum ins = InstructionEnum(i);
+				if (!instructionName(ins))
+					continue;
+				if (n == instructionName(ins) || n == instructionCategory(ins))
+				{
+					mask[i] = true;
+					found = true;
+				}
+			}
+			if (!found)
+			{
+				CAGE_LOG_THROW(stringizer() + "name: " + n);
+				CAGE_THROW_ERROR(Exception, "unknown instruction or category");
+			}
+		}
+		return mask;
+	}
+
+	InstructionEnum immediateForm(InstructionEnum instruction)
+	{
+		switch (instruction)
+		{
+#define QASM_IMMEDIATE_CASE(NAME) case InstructionEnum::NAME: return InstructionEnum::NAME##imm;
+		CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(QASM_IMMEDIATE_CASE, QASM_IMMEDIATE_INSTRUCTIONS_1))
+		CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(QASM_IMMEDIATE_CASE, QASM_IMMEDIATE_INSTRUCTIONS_2))
+		CAGE_EVAL_SMALL(CAGE_EXPAND_ARGS(QASM_IMMEDIATE_CASE, QASM_IMMEDIATE_INSTRUCTIONS_3))
+#undef QASM_IMMEDIATE_CASE
+		default:
+			return InstructionEnum::nop;
+		}
+	}
+
+	InstructionEnum mirroredForm(InstructionEnum instruction)
+	{
+		switch (instruction)
+		{
+		// commutative
+		case InstructionEnum::add:
+		case InstructionEnum::mul:
+		case InstructionEnum::iadd:
+		case InstructionEnum::imul:
+		case InstructionEnum::band:
+		case InstructionEnum::bor:
+		case InstructionEnum::bxor:
+		case InstructionEnum::fadd:
+		case InstructionEnum::fmul:
+		case InstructionEnum::eq:
+		case InstructionEnum::neq:
+		case InstructionEnum::ieq:
+		case InstructionEnum::ineq:
+		case InstructionEnum::feq:
+		case InstructionEnum::fneq:
+			return instruction;
+		// mirrored
+		case InstructionEnum::lt: return InstructionEnum::gt;
+		case InstructionEnum::gt: return InstructionEnum::lt;
+		case InstructionEnum::lte: return InstructionEnum::gte;
+		case InstructionEnum::gte: return InstructionEnum::lte;
+		case InstructionEnum::ilt: return InstructionEnum::igt;
+		case InstructionEnum::igt: return InstructionEnum::ilt;
+		case InstructionEnum::ilte: return InstructionEnum::igte;
+		case InstructionEnum::igte: return InstructionEnum::ilte;
+		case InstructionEnum::flt: return InstructionEnum::fgt;
+		case InstructionEnum::fgt: return InstructionEnum::flt;
+		case InstructionEnum::flte: return InstructionEnum::fgte;
+		case InstructionEnum::fgte: return InstructionEnum::flte;
+		default:
+			return InstructionEnum::nop;
+		}
+	}
+
+	bool canEvaluateBinary(InstructionEnum instruction, uint32 left, uint32 right)
+	{
+		if (immediateForm(instruction) == InstructionEnum::nop)
+			return false;
+		const sint32 il = *(sint32 *)&left, ir = *(sint32 *)&right;
+		switch (instruction)
+		{
+		case InstructionEnum::div:
+		case InstructionEnum::mod:
+			return right != 0;
+		case InstructionEnum::iadd:
+		case InstructionEnum::isub:
+		case InstructionEnum::imul:
+		{
+			// signed overflow
+			const sint64 l = il, r = ir;
+			const sint64 v = instruction == InstructionEnum::iadd ? l + r : instruction == InstructionEnum::isub ? l - r : l * r;
+			return v >= std::numeric_limits<sint32>::min() && v <= std::numeric_limits<sint32>::max();
+		}
+		case InstructionEnum::idiv:
+		case InstructionEnum::imod:
+			return ir != 0 && !(il == std::numeric_limits<sint32>::min() && ir == -1);
+		case InstructionEnum::shl:
+		case InstructionEnum::shr:
+			return right < 32;
+		default:
+			return true;
+		}
+	}
+}
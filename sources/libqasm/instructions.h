@@ -0,0 +1,146 @@
+#ifndef instructions_h_f6g4j8r7t
+#define instructions_h_f6g4j8r7t
+
+#include <cage-core/math.h>
+#include <cage-core/macros.h>
+
+#include "program.h"
+
+#include <bitset>
+
+namespace qasm
+{
+	// operands of an instruction, in order of their serialization:
+	// d - register written to
+	// c - register written to only conditionally
+	// r - register read from
+	// x - register read from and written to
+	// S, Q, T, M - index of structure of the respective type
+	// y - structure type, followed by index of structure of that type (k)
+	// u - uint32, i - sint32, f - float
+	// l - instruction index (jump or call target)
+	// b - bool
+	struct InstructionInfo
+	{
+		const char *operands = "";
+		uint64 implicitReads = 0; // bit mask of registers (bit index is the register index)
+		uint64 implicitWrites = 0;
+		bool writesAnyRegister = false;
+	};
+
+	InstructionInfo instructionInfo(InstructionEnum instruction);
+
+	constexpr uint32 InstructionsCount = uint32(InstructionEnum::disabled) + 1;
+
+	// name of the instruction as written in the source code, and name of its category (as in the documentation)
+	// immediate and verified forms have the names of the instructions they were made from
+	// returns nullptr for instructions that cannot be written in the source code (eg. exit)
+	const char *instructionName(InstructionEnum instruction);
+	const char *instructionCategory(InstructionEnum instruction);
+
+	// instructions matching any of the names of instructions or categories, throws on unknown names
+	std::bitset<InstructionsCount> instructionsMask(PointerRange<const string> names);
+
+	constexpr uint32 operandSize(char operand)
+	{
+		switch (operand)
+		{
+		case 'u':
+		case 'i':
+		case 'f':
+		case 'l':
+			return 4;
+		default:
+			return 1;
+		}
+	}
+
+	constexpr uint8 implicitRegister(char name)
+	{
+		return name - 'a' + 26;
+	}
+
+	constexpr uint64 implicitRegisters(const char *names)
+	{
+		uint64 res = 0;
+		while (*names)
+			res |= uint64(1) << implicitRegister(*names++);
+		return res;
+	}
+
+	// instructions with three registers that have immediate operand form, where the last register is replaced by an uint32 value
+#define QASM_IMMEDIATE_INSTRUCTIONS_1 add, sub, mul, div, mod, iadd, isub, imul, idiv, imod, shl, shr, band, bor, bxor
+#define QASM_IMMEDIATE_INSTRUCTIONS_2 eq, neq, lt, gt, lte, gte, ieq, ineq, ilt, igt, ilte, igte
+#define QASM_IMMEDIATE_INSTRUCTIONS_3 fadd, fsub, fmul, fdiv, feq, fneq, flt, fgt, flte, fgte
+
+	InstructionEnum immediateForm(InstructionEnum instruction); // returns nop if the instruction has no immediate form
+	InstructionEnum mirroredForm(InstructionEnum instruction); // instruction with swapped left and right operands (e.g. lt -> gt), or nop
+
+	// returns false if the operation cannot be evaluated without runtime error or undefined behavior
+	bool canEvaluateBinary(InstructionEnum instruction, uint32 left, uint32 right);
+
+	// evaluates instruction with three registers on raw register values
+	inline uint32 evaluateBinary(InstructionEnum instruction, uint32 left, uint32 right)
+	{
+		const sint32 il = *(sint32 *)&left, ir = *(sint32 *)&right;
+		const real fl = *(real *)&left, fr = *(real *)&right;
+		const auto sres = [](sint32 v) { return *(uint32 *)&v; };
+		const auto fres = [](real v) { return *(uint32 *)&v; };
+		switch (instruction)
+		{
+		case InstructionEnum::add: return left + right;
+		case InstructionEnum::sub: return left - right;
+		case InstructionEnum::mul: return left * right;
+		case InstructionEnum::div:
+			if (right == 0)
+				CAGE_THROW_ERROR(Exception, "division by zero");
+			return left / right;
+		case InstructionEnum::mod:
+			if (right == 0)
+				CAGE_THROW_ERROR(Exception, "division by zero");
+			return left % right;
+		case InstructionEnum::iadd: return sres(il + ir);
+		case InstructionEnum::isub: return sres(il - ir);
+		case InstructionEnum::imul: return sres(il * ir);
+		case InstructionEnum::idiv:
+			if (ir == 0)
+				CAGE_THROW_ERROR(Exception, "division by zero");
+			return sres(il / ir);
+		case InstructionEnum::imod:
+			if (ir == 0)
+				CAGE_THROW_ERROR(Exception, "division by zero");
+			return sres(il % ir);
+		case InstructionEnum::shl: return left << right;
+		case InstructionEnum::shr: return left >> right;
+		case InstructionEnum::band: return left & right;
+		case InstructionEnum::bor: return left | right;
+		case InstructionEnum::bxor: return left ^ right;
+		case InstructionEnum::fadd: return fres(fl + fr);
+		case InstructionEnum::fsub: return fres(fl - fr);
+		case InstructionEnum::fmul: return fres(fl * fr);
+		case InstructionEnum::fdiv: return fres(fl / fr);
+		case InstructionEnum::eq: return left == right;
+		case InstructionEnum::neq: return left != right;
+		case InstructionEnum::lt: return left < right;
+		case InstructionEnum::gt: return left > right;
+		case InstructionEnum::lte: return left <= right;
+		case InstructionEnum::gte: return left >= right;
+		case InstructionEnum::ieq: return il == ir;
+		case InstructionEnum::ineq: return il != ir;
+		case InstructionEnum::ilt: return il < ir;
+		case InstructionEnum::igt: return il > ir;
+		case InstructionEnum::ilte: return il <= ir;
+		case InstructionEnum::igte: return il >= ir;
+		case InstructionEnum::feq: return fl == fr;
+		case InstructionEnum::fneq: return fl != fr;
+		case InstructionEnum::flt: return fl < fr;
+		case InstructionEnum::fgt: return fl > fr;
+		case InstructionEnum::flte: return fl <= fr;
+		case InstructionEnum::fgte: return fl >= fr;
+		default:
+			CAGE_THROW_CRITICAL(Exception, "instruction cannot be evaluated");
+		}
+	}
+}
+
+#endif // instructions_h_f6g4j8r7t
@@ -1,6 +1,9 @@
 #include <cage-core/ini.h>
 
 #include "qasm/qasm.h"
+#include "instructions.h"
+
+#include <algorithm> // find
 
 namespace qasm
 {
@@ -34,6 +37,22 @@ namespace qasm
 
 		limits.callstackCapacity = ini->getUint32("callstack", "capacity", limits.callstackCapacity);
 
+		{ // instructions
+			std::vector<string> &disabled = limits.disabledInstructions;
+			for (const string &name : ini->items("disabled"))
+			{
+				auto it = std::find(disabled.begin(), disabled.end(), name);
+				if (ini->getBool("disabled", name))
+				{
+					if (it == disabled.end())
+						disabled.push_back(name);
+				}
+				else if (it != disabled.end())
+					disabled.erase(it);
+			}
+			instructionsMask(disabled); // validate the names
+		}
+
 		return limits;
 	}
 
@@ -64,5 +83,10 @@ namespace qasm
 		}
 
 		ini->setUint32("callstack", "capacity", limits.callstackCapacity);
+
+		{ // instructions
+			for (const string &name : limits.disabledInstructions)
+				ini->setBool("disabled", name, true);
+		}
 	}
 }
@@ -0,0 +1,131 @@
+#include <cage-core/memoryBuffer.h>
+
+#include <qasm/qasm.h>
+
+#include <cstring> // memchr
+
+namespace qasm
+{
+	namespace
+	{
+		// extracts next line (without line ending) from the buffer starting at position
+		bool nextLine(PointerRange<const char> buffer, uintPtr &position, PointerRange<const char> &line)
+		{
+			if (position >= buffer.size())
+				return false;
+			const char *b = buffer.data() + position;
+			const char *e = (const char *)std::memchr(b, '\n', buffer.size() - position);
+			if (e)
+				position = e - buffer.data() + 1;
+			else
+			{
+				e = buffer.end();
+				position = buffer.size();
+			}
+			if (e > b && e[-1] == '\r')
+				e--;
+			line = { b, e };
+			return true;
+		}
+	}
+
+	struct MemoryIoImpl : public MemoryIo
+	{
+		PointerRange<const char> inputBuffer;
+		PointerRange<const char> expectedBuffer;
+		MemoryBuffer outputBuffer;
+		Cpu *interruptOnMismatch = nullptr;
+		uintPtr inputPosition = 0;
+		uintPtr expectedPosition = 0;
+		uint32 linesWritten = 0;
+		uint32 mismatch = m;
+
+		bool readLine(string &line)
+		{
+			PointerRange<const char> l;
+			if (!nextLine(inputBuffer, inputPosition, l))
+				return false;
+			line = string(l);
+			return true;
+		}
+
+		bool writeLine(const string &line)
+		{
+			const uintPtr pos = outputBuffer.size();
+			outputBuffer.resizeSmart(pos + line.length() + 1);
+			detail::memcpy(outputBuffer.data() + pos, line.data(), line.length());
+			outputBuffer.data()[pos + line.length()] = '\n';
+			if (expectedBuffer.data() && mismatch == m)
+			{
+				PointerRange<const char> e;
+				if (!nextLine(expectedBuffer, expectedPosition, e) || e.size() != line.length() || detail::memcmp(e.data(), line.data(), e.size()) != 0)
+				{
+					mismatch = linesWritten;
+					if (interruptOnMismatch)
+						interruptOnMismatch->interrupt();
+				}
+			}
+			linesWritten++;
+			return true;
+		}
+	};
+
+	void MemoryIo::input(PointerRange<const char> buffer)
+	{
+		MemoryIoImpl *impl = (MemoryIoImpl *)this;
+		impl->inputBuffer = buffer;
+		impl->inputPosition = 0;
+	}
+
+	void MemoryIo::expectedOutput(PointerRange<const char> buffer, Cpu *interruptOnMismatch)
+	{
+		MemoryIoImpl *impl = (MemoryIoImpl *)this;
+		CAGE_ASSERT(impl->linesWritten == 0);
+		impl->expectedBuffer = buffer;
+		impl->interruptOnMismatch = interruptOnMismatch;
+	}
+
+	void MemoryIo::reset()
+	{
+		MemoryIoImpl *impl = (MemoryIoImpl *)this;
+		impl->outputBuffer.resize(0);
+		impl->inputPosition = 0;
+		impl->expectedPosition = 0;
+		impl->linesWritten = 0;
+		impl->mismatch = m;
+	}
+
+	void MemoryIo::bind(CpuCreateConfig &config)
+	{
+		MemoryIoImpl *impl = (MemoryIoImpl *)this;
+		config.input.bind<MemoryIoImpl, &MemoryIoImpl::readLine>(impl);
+		config.output.bind<MemoryIoImpl, &MemoryIoImpl::writeLine>(impl);
+	}
+
+	PointerRange<const char> MemoryIo::output() const
+	{
+		const MemoryIoImpl *impl = (const MemoryIoImpl *)this;
+		return impl->outputBuffer;
+	}
+
+	uint32 MemoryIo::mismatchLine() const
+	{
+		const MemoryIoImpl *impl = (const MemoryIoImpl *)this;
+		return impl->mismatch;
+	}
+
+	bool MemoryIo::outputMatches() const
+	{
+		const MemoryIoImpl *impl = (const MemoryIoImpl *)this;
+		if (impl->mismatch != m)
+			return false;
+		uintPtr pos = impl->expectedPosition;
+		PointerRange<const char> l;
+		return !nextLine(impl->expectedBuffer, pos, l);
+	}
+
+	Holder<MemoryIo> newMemoryIo()
+	{
+		return detail::systemArena().createImpl<MemoryIo, MemoryIoImpl>();
+	}
+}
@@ -0,0 +1,301 @@
+#include "optimizer.h"
+#include "instructions.h"
+
+namespace qasm
+{
+	namespace
+	{
+		constexpr uint8 RegisterZ = implicitRegister('z');
+
+		struct Value
+		{
+			enum KindEnum : uint8
+			{
+				Unknown = 0, // not reached yet
+				Constant,
+				Varying,
+			};
+
+			uint32 value = 0;
+			KindEnum kind = Unknown;
+
+			bool constant() const { return kind == Constant; }
+
+			static Value make(uint32 v)
+			{
+				Value r;
+				r.kind = Constant;
+				r.value = v;
+				return r;
+			}
+
+			static Value varying()
+			{
+				Value r;
+				r.kind = Varying;
+				return r;
+			}
+
+			bool meet(const Value &other)
+			{
+				if (other.kind == Unknown || kind == Varying)
+					return false;
+				if (kind == Unknown)
+				{
+					*this = other;
+					return true;
+				}
+				if (other.kind == Varying || other.value != value)
+				{
+					*this = varying();
+					return true;
+				}
+				return false;
+			}
+		};
+
+		struct State
+		{
+			Value registers[26 + 26];
+			bool reached = false;
+
+			static State varying()
+			{
+				State s;
+				s.reached = true;
+				for (Value &v : s.registers)
+					v = Value::varying();
+				return s;
+			}
+
+			bool meet(const State &other)
+			{
+				bool changed = !reached;
+				reached = true;
+				for (uint32 i = 0; i < 26 + 26; i++)
+					changed |= registers[i].meet(other.registers[i]);
+				return changed;
+			}
+
+			// returns 0 or 1 if the condition register is known, m otherwise
+			uint32 condition() const
+			{
+				const Value &z = registers[RegisterZ];
+				return z.constant() ? uint32(z.value != 0) : m;
+			}
+		};
+
+		InstructionEnum unconditionalForm(InstructionEnum instruction)
+		{
+			switch (instruction)
+			{
+			case InstructionEnum::condrst: return InstructionEnum::reset;
+			case InstructionEnum::condset: return InstructionEnum::set;
+			case InstructionEnum::condiset: return InstructionEnum::iset;
+			case InstructionEnum::condfset: return InstructionEnum::fset;
+			case InstructionEnum::condcpy: return InstructionEnum::copy;
+			case InstructionEnum::condjmp: return InstructionEnum::jump;
+			case InstructionEnum::condcall: return InstructionEnum::call;
+			case InstructionEnum::condreturn: return InstructionEnum::return_;
+			default: return InstructionEnum::nop;
+			}
+		}
+
+		// value written by an instruction to its first operand, assuming the instruction is executed unconditionally
+		Value evaluate(const OptimizerInstruction &ins, const State &s)
+		{
+			const uint32 *o = ins.operands;
+			switch (ins.opcode)
+			{
+			case InstructionEnum::reset:
+			case InstructionEnum::condrst:
+				return Value::make(0);
+			case InstructionEnum::set:
+			case InstructionEnum::iset:
+			case InstructionEnum::fset:
+			case InstructionEnum::condset:
+			case InstructionEnum::condiset:
+			case InstructionEnum::condfset:
+				return Value::make(o[1]);
+			case InstructionEnum::copy:
+			case InstructionEnum::condcpy:
+				return s.registers[o[1]];
+			case InstructionEnum::inc:
+				return s.registers[o[0]].constant() ? Value::make(s.registers[o[0]].value + 1) : Value::varying();
+			case InstructionEnum::dec:
+				return s.registers[o[0]].constant() ? Value::make(s.registers[o[0]].value - 1) : Value::varying();
+			default:
+				break;
+			}
+			if (immediateForm(ins.opcode) != InstructionEnum::nop)
+			{
+				const Value &l = s.registers[o[1]], &r = s.registers[o[2]];
+				if (l.constant() && r.constant() && canEvaluateBinary(ins.opcode, l.value, r.value))
+					return Value::make(evaluateBinary(ins.opcode, l.value, r.value));
+			}
+			return Value::varying();
+		}
+
+		void transfer(const OptimizerInstruction &ins, State &s)
+		{
+			const InstructionInfo info = instructionInfo(ins.opcode);
+			if (info.writesAnyRegister)
+			{
+				s = State::varying();
+				return;
+			}
+
+			const InstructionEnum uncond = unconditionalForm(ins.opcode);
+			if (uncond != InstructionEnum::nop && info.operands[0] == 'c')
+			{
+				const uint32 cond = s.condition();
+				if (cond == 0)
+					return;
+				const Value v = evaluate(ins, s);
+				if (cond == 1)
+					s.registers[ins.operands[0]] = v;
+				else
+					s.registers[ins.operands[0]].meet(v);
+				return;
+			}
+
+			if (info.operands[0] == 'd' || info.operands[0] == 'x')
+			{
+				const Value v = evaluate(ins, s);
+				s.registers[ins.operands[0]] = v;
+			}
+			for (uint32 j = 1; info.operands[j]; j++)
+				if (info.operands[j] == 'd' || info.operands[j] == 'c' || info.operands[j] == 'x')
+					s.registers[ins.operands[j]] = Value::varying();
+			if (info.operands[0] == 'c')
+				s.registers[ins.operands[0]] = Value::varying();
+			for (uint32 i = 0; i < 26 + 26; i++)
+				if (info.implicitWrites & (uint64(1) << i))
+					s.registers[i] = Value::varying();
+		}
+
+		void rewrite(OptimizerInstruction &ins, const State &s)
+		{
+			uint32 *o = ins.operands;
+
+			const InstructionEnum uncond = unconditionalForm(ins.opcode);
+			if (uncond != InstructionEnum::nop)
+			{
+				const uint32 cond = s.condition();
+				if (cond == 0)
+				{
+					ins.opcode = InstructionEnum::nop;
+					return;
+				}
+				if (cond == 1)
+					ins.opcode = uncond;
+			}
+
+			switch (ins.opcode)
+			{
+			case InstructionEnum::copy:
+			case InstructionEnum::inc:
+			case InstructionEnum::dec:
+			{
+				const Value v = evaluate(ins, s);
+				if (v.constant())
+				{
+					ins.opcode = InstructionEnum::set;
+					o[1] = v.value;
+				}
+				return;
+			}
+			default:
+				break;
+			}
+
+			const InstructionEnum imm = immediateForm(ins.opcode);
+			if (imm == InstructionEnum::nop)
+				return;
+			const Value &l = s.registers[o[1]], &r = s.registers[o[2]];
+			const Value v = evaluate(ins, s);
+			if (v.constant())
+			{
+				ins.opcode = InstructionEnum::set;
+				o[1] = v.value;
+				o[2] = 0;
+			}
+			else if (r.constant())
+			{
+				ins.opcode = imm;
+				o[2] = r.value;
+			}
+			else if (l.constant() && mirroredForm(ins.opcode) != InstructionEnum::nop)
+			{
+				ins.opcode = immediateForm(mirroredForm(ins.opcode));
+				o[1] = o[2];
+				o[2] = l.value;
+			}
+		}
+	}
+
+	// forward dataflow analysis of register values with rewriting of instructions whose operands are known
+	// each instruction is replaced by at most one instruction, therefore step counts and source lines are unaffected
+	void optimizeConstants(OptimizerProgram &program)
+	{
+		const uint32 count = numeric_cast<uint32>(program.size());
+		std::vector<State> states;
+		states.resize(count);
+		std::vector<uint32> worklist;
+
+		const auto &propagate = [&](uint32 target, const State &s) {
+			if (target < count && states[target].meet(s))
+				worklist.push_back(target);
+		};
+
+		// registers are unknown at program start and at entry to any function
+		propagate(0, State::varying());
+		for (const OptimizerInstruction &ins : program)
+			if (ins.opcode == InstructionEnum::call || ins.opcode == InstructionEnum::condcall)
+				propagate(ins.operands[0], State::varying());
+
+		while (!worklist.empty())
+		{
+			const uint32 index = worklist.back();
+			worklist.pop_back();
+			const OptimizerInstruction &ins = program[index];
+			State s = states[index];
+			const uint32 cond = s.condition();
+			transfer(ins, s);
+			switch (ins.opcode)
+			{
+			case InstructionEnum::jump:
+				propagate(ins.operands[0], s);
+				break;
+			case InstructionEnum::condjmp:
+				if (cond != 0)
+					propagate(ins.operands[0], s);
+				if (cond != 1)
+					propagate(index + 1, s);
+				break;
+			case InstructionEnum::call:
+			case InstructionEnum::condcall:
+				// the function may modify any register
+				propagate(index + 1, State::varying());
+				break;
+			case InstructionEnum::condreturn:
+				if (cond != 1)
+					propagate(index + 1, s);
+				break;
+			case InstructionEnum::return_:
+			case InstructionEnum::exit:
+			case InstructionEnum::terminate:
+			case InstructionEnum::unreachable:
+			case InstructionEnum::disabled:
+				break;
+			default:
+				propagate(index + 1, s);
+				break;
+			}
+		}
+
+		for (uint32 i = 0; i < count; i++)
+			if (states[i].reached)
+				rewrite(program[i], states[i]);
+	}
+}
@@ -0,0 +1,59 @@
+#include "optimizer.h"
+
+namespace qasm
+{
+	// removes instructions that can never be executed, including whole functions that are never called, and compacts the program
+	// removed instructions are never executed, therefore step counts are unaffected
+	void optimizeDeadCode(OptimizerProgram &program)
+	{
+		const uint32 count = numeric_cast<uint32>(program.size());
+		std::vector<bool> reachable;
+		reachable.resize(count, false);
+		std::vector<uint32> worklist;
+
+		const auto &mark = [&](uint32 index) {
+			if (index < count && !reachable[index])
+			{
+				reachable[index] = true;
+				worklist.push_back(index);
+			}
+		};
+
+		mark(0);
+		while (!worklist.empty())
+		{
+			const uint32 index = worklist.back();
+			worklist.pop_back();
+			const OptimizerInstruction &ins = program[index];
+			switch (ins.opcode)
+			{
+			case InstructionEnum::jump:
+				mark(ins.operands[0]);
+				break;
+			case InstructionEnum::condjmp:
+			case InstructionEnum::call:
+			case InstructionEnum::condcall:
+				mark(ins.operands[0]);
+				mark(index + 1);
+				break;
+			case InstructionEnum::return_:
+			case InstructionEnum::exit:
+			case InstructionEnum::terminate:
+			case InstructionEnum::unreachable:
+			case InstructionEnum::disabled:
+				break;
+			default:
+				mark(index + 1);
+				break;
+			}
+		}
+
+		std::vector<uint32> order;
+		order.reserve(count);
+		for (uint32 i = 0; i < count; i++)
+			if (reachable[i])
+				order.push_back(i);
+		if (order.size() != count)
+			optimizerRearrange(program, order);
+	}
+}
@@ -0,0 +1,169 @@
+#include "optimizer.h"
+#include "instructions.h"
+
+#include <algorithm> // lower_bound, sort
+#include <unordered_map>
+
+namespace qasm
+{
+	namespace
+	{
+		constexpr uint32 InlineLimit = 32; // maximum number of instructions of an inlined function
+
+		// indices of instructions of the function, in program order, or empty if the function cannot be inlined
+		std::vector<uint32> inlinableBody(const OptimizerProgram &program, uint32 entry)
+		{
+			const uint32 count = numeric_cast<uint32>(program.size());
+			std::vector<uint32> body;
+			std::vector<uint32> worklist;
+			const auto &mark = [&](uint32 index) {
+				if (index < count && std::find(body.begin(), body.end(), index) == body.end())
+				{
+					body.push_back(index);
+					worklist.push_back(index);
+				}
+			};
+
+			mark(entry);
+			while (!worklist.empty())
+			{
+				if (body.size() > InlineLimit)
+					return {};
+				const uint32 index = worklist.back();
+				worklist.pop_back();
+				const OptimizerInstruction &ins = program[index];
+				switch (ins.opcode)
+				{
+				case InstructionEnum::call:
+				case InstructionEnum::condcall:
+					return {}; // not a leaf function
+				case InstructionEnum::jump:
+					mark(ins.operands[0]);
+					break;
+				case InstructionEnum::condjmp:
+					mark(ins.operands[0]);
+					mark(index + 1);
+					break;
+				case InstructionEnum::return_:
+				case InstructionEnum::exit:
+				case InstructionEnum::terminate:
+				case InstructionEnum::unreachable:
+				case InstructionEnum::disabled:
+					break;
+				default:
+					mark(index + 1);
+					break;
+				}
+			}
+			if (body.size() > InlineLimit)
+				return {};
+			std::sort(body.begin(), body.end());
+			return body;
+		}
+	}
+
+	// replaces calls of small functions, that do not call any other functions, with copies of their bodies
+	// the call is replaced by nop and returns become jumps, therefore the step counts are unaffected
+	// the copied instructions keep their source lines and function indices
+	void optimizeInlining(OptimizerProgram &program)
+	{
+		const uint32 count = numeric_cast<uint32>(program.size());
+
+		std::unordered_map<uint32, std::vector<uint32>> bodies; // function entry -> body
+		bool any = false;
+		for (const OptimizerInstruction &ins : program)
+		{
+			if (ins.opcode != InstructionEnum::call)
+				continue;
+			auto it = bodies.find(ins.operands[0]);
+			if (it == bodies.end())
+				it = bodies.emplace(ins.operands[0], inlinableBody(program, ins.operands[0])).first;
+			any |= !it->second.empty();
+		}
+		if (!any)
+			return;
+
+		struct Copy
+		{
+			uint32 base = 0; // index of the first copied instruction in the result
+			const std::vector<uint32> *body = nullptr;
+		};
+		std::vector<Copy> copies;
+		constexpr uint32 Original = uint32(-1);
+		constexpr uint32 Resolved = uint32(-2);
+		std::vector<uint32> origins; // for each instruction in the result: how to resolve its targets (Original, Resolved or index of the copy)
+
+		OptimizerProgram result;
+		std::vector<uint32> remap;
+		remap.resize(count, m);
+		for (uint32 i = 0; i < count; i++)
+		{
+			const OptimizerInstruction &ins = program[i];
+			remap[i] = numeric_cast<uint32>(result.size());
+			const std::vector<uint32> *body = ins.opcode == InstructionEnum::call ? &bodies[ins.operands[0]] : nullptr;
+			if (!body || body->empty())
+			{
+				result.push_back(ins);
+				origins.push_back(Original);
+				continue;
+			}
+
+			{ // the call itself
+				OptimizerInstruction n;
+				n.sourceLine = ins.sourceLine;
+				n.functionIndex = ins.functionIndex;
+				n.weight.steps = ins.weight.steps + ins.weight.jumpSteps;
+				result.push_back(n);
+				origins.push_back(Resolved);
+			}
+
+			Copy c;
+			c.base = numeric_cast<uint32>(result.size());
+			c.body = body;
+			const uint32 after = c.base + numeric_cast<uint32>(body->size());
+			for (const uint32 k : *body)
+			{
+				OptimizerInstruction b = program[k];
+				switch (b.opcode)
+				{
+				case InstructionEnum::return_:
+				case InstructionEnum::condreturn:
+					b.opcode = b.opcode == InstructionEnum::return_ ? InstructionEnum::jump : InstructionEnum::condjmp;
+					b.operands[0] = after;
+					b.weight.jumpSteps = 0;
+					origins.push_back(Resolved);
+					break;
+				default:
+					origins.push_back(numeric_cast<uint32>(copies.size()));
+					break;
+				}
+				result.push_back(b);
+			}
+			copies.push_back(c);
+		}
+
+		for (uint32 i = 0; i < result.size(); i++)
+		{
+			if (origins[i] == Resolved)
+				continue;
+			OptimizerInstruction &ins = result[i];
+			const char *operands = instructionInfo(ins.opcode).operands;
+			for (uint32 j = 0; operands[j]; j++)
+			{
+				if (operands[j] != 'l')
+					continue;
+				if (origins[i] == Original)
+					ins.operands[j] = remap[ins.operands[j]];
+				else
+				{
+					const Copy &c = copies[origins[i]];
+					const auto it = std::lower_bound(c.body->begin(), c.body->end(), ins.operands[j]);
+					CAGE_ASSERT(it != c.body->end() && *it == ins.operands[j]);
+					ins.operands[j] = c.base + numeric_cast<uint32>(it - c.body->begin());
+				}
+			}
+		}
+
+		std::swap(program, result);
+	}
+}
@@ -0,0 +1,161 @@
+#include "optimizer.h"
+#include "instructions.h"
+
+namespace qasm
+{
+	namespace
+	{
+		bool isBranch(InstructionEnum instruction)
+		{
+			switch (instruction)
+			{
+			case InstructionEnum::jump:
+			case InstructionEnum::condjmp:
+			case InstructionEnum::call:
+			case InstructionEnum::condcall:
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		// the following instruction may be executed after this one
+		bool fallsThrough(InstructionEnum instruction)
+		{
+			switch (instruction)
+			{
+			case InstructionEnum::jump:
+			case InstructionEnum::return_:
+			case InstructionEnum::exit:
+			case InstructionEnum::terminate:
+			case InstructionEnum::unreachable:
+			case InstructionEnum::disabled:
+				return false;
+			default:
+				return true;
+			}
+		}
+
+		// the following instruction is always executed right after this one, unless this one fails
+		bool alwaysFallsThrough(InstructionEnum instruction)
+		{
+			switch (instruction)
+			{
+			case InstructionEnum::condjmp:
+			case InstructionEnum::call:
+			case InstructionEnum::condcall:
+			case InstructionEnum::condreturn:
+			case InstructionEnum::breakpoint:
+				return false;
+			default:
+				return fallsThrough(instruction);
+			}
+		}
+	}
+
+	// redirects jumps and calls that lead to unconditional jumps or nops directly to their final destination
+	// the skipped instructions are accounted for in the step weights
+	void optimizeJumpThreading(OptimizerProgram &program)
+	{
+		const uint32 count = numeric_cast<uint32>(program.size());
+		for (OptimizerInstruction &ins : program)
+		{
+			if (!isBranch(ins.opcode))
+				continue;
+			uint32 target = ins.operands[0];
+			uint32 steps = 0;
+			uint32 hops = 0;
+			while (hops < count)
+			{
+				const OptimizerInstruction &j = program[target];
+				if (j.opcode == InstructionEnum::jump)
+				{
+					steps += 1 + j.weight.steps + j.weight.jumpSteps;
+					target = j.operands[0];
+				}
+				else if (j.opcode == InstructionEnum::nop && target + 1 < count)
+				{
+					steps += 1 + j.weight.steps;
+					target++;
+				}
+				else
+					break;
+				hops++;
+			}
+			if (hops == count)
+				continue; // infinite loop of jumps
+			ins.operands[0] = target;
+			ins.weight.jumpSteps += steps;
+		}
+	}
+
+	// places code reached by unconditional jump right after the jump and removes the jump
+	// sequences of instructions that fall through into each other are never split
+	// also removes nops that are not targets of any jump
+	void optimizeBlockLayout(OptimizerProgram &program)
+	{
+		const uint32 count = numeric_cast<uint32>(program.size());
+
+		std::vector<uint32> chainStarts;
+		std::vector<uint32> chainOf;
+		chainOf.reserve(count);
+		for (uint32 i = 0; i < count; i++)
+		{
+			if (i == 0 || !fallsThrough(program[i - 1].opcode))
+				chainStarts.push_back(i);
+			chainOf.push_back(numeric_cast<uint32>(chainStarts.size() - 1));
+		}
+		const uint32 chainsCount = numeric_cast<uint32>(chainStarts.size());
+		const auto &chainEnd = [&](uint32 chain) { return chain + 1 < chainsCount ? chainStarts[chain + 1] : count; };
+
+		std::vector<bool> targeted;
+		targeted.resize(count, false);
+		for (const OptimizerInstruction &ins : program)
+		{
+			const char *operands = instructionInfo(ins.opcode).operands;
+			for (uint32 j = 0; operands[j]; j++)
+				if (operands[j] == 'l')
+					targeted[ins.operands[j]] = true;
+		}
+
+		std::vector<bool> placed;
+		placed.resize(chainsCount, false);
+		std::vector<uint32> order;
+		order.reserve(count);
+		for (uint32 first = 0; first < chainsCount; first++)
+		{
+			uint32 chain = first;
+			while (!placed[chain])
+			{
+				placed[chain] = true;
+				const uint32 start = numeric_cast<uint32>(order.size());
+				for (uint32 i = chainStarts[chain]; i < chainEnd(chain); i++)
+				{
+					if (i != chainStarts[chain] && program[i].opcode == InstructionEnum::nop && !targeted[i] && alwaysFallsThrough(program[order.back()].opcode))
+						program[order.back()].weight.steps += 1 + program[i].weight.steps;
+					else
+						order.push_back(i);
+				}
+
+				const uint32 last = chainEnd(chain) - 1;
+				const OptimizerInstruction &j = program[last];
+				if (j.opcode != InstructionEnum::jump || targeted[last] || order.size() - start < 2)
+					break;
+				const uint32 next = chainOf[j.operands[0]];
+				if (chainStarts[next] != j.operands[0] || next == 0 || program[chainStarts[next]].functionIndex != j.functionIndex)
+					break;
+				OptimizerInstruction &prev = program[order[order.size() - 2]];
+				if (placed[next] || !alwaysFallsThrough(prev.opcode))
+					break;
+
+				// the previous instruction takes over the steps of the removed jump
+				prev.weight.steps += 1 + j.weight.steps + j.weight.jumpSteps;
+				order.pop_back();
+				chain = next;
+			}
+		}
+
+		if (order.size() != count)
+			optimizerRearrange(program, order);
+	}
+}
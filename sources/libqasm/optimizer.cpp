@@ -0,0 +1,118 @@
+#include <cage-core/pointerRangeHolder.h>
+#include <cage-core/serialization.h>
+
+#include "optimizer.h"
+#include "instructions.h"
+
+namespace qasm
+{
+	OptimizerProgram optimizerDecode(const ProgramSections &sections)
+	{
+		OptimizerProgram program;
+		program.reserve(sections.instructions.size());
+		for (uintPtr i = 0; i < sections.instructions.size(); i++)
+		{
+			OptimizerInstruction ins;
+			ins.opcode = sections.instructions[i];
+			ins.sourceLine = sections.sourceLines[i];
+			ins.functionIndex = sections.functionIndices[i];
+			if (!sections.stepWeights.empty())
+				ins.weight = sections.stepWeights[i];
+			Deserializer des(sections.params);
+			des.advance(sections.paramsOffsets[i]);
+			const char *operands = instructionInfo(ins.opcode).operands;
+			for (uint32 j = 0; operands[j]; j++)
+			{
+				CAGE_ASSERT(j < 3);
+				if (operandSize(operands[j]) == 4)
+					des >> ins.operands[j];
+				else
+				{
+					uint8 v;
+					des >> v;
+					ins.operands[j] = v;
+				}
+			}
+			program.push_back(ins);
+		}
+		return program;
+	}
+
+	void optimizerRearrange(OptimizerProgram &program, const std::vector<uint32> &order)
+	{
+		std::vector<uint32> remap;
+		remap.resize(program.size(), m);
+		for (uint32 i = 0; i < order.size(); i++)
+			remap[order[i]] = i;
+
+		OptimizerProgram result;
+		result.reserve(order.size());
+		for (const uint32 index : order)
+		{
+			OptimizerInstruction ins = program[index];
+			const char *operands = instructionInfo(ins.opcode).operands;
+			for (uint32 j = 0; operands[j]; j++)
+			{
+				if (operands[j] == 'l')
+				{
+					CAGE_ASSERT(remap[ins.operands[j]] != m);
+					ins.operands[j] = remap[ins.operands[j]];
+				}
+			}
+			result.push_back(ins);
+		}
+		std::swap(program, result);
+	}
+
+	MemoryBuffer programOptimize(const CompilerCreateConfig &config, const ProgramSections &sections)
+	{
+		OptimizerProgram program = optimizerDecode(sections);
+
+		if (config.inlining)
+			optimizeInlining(program);
+		if (config.constantPropagation)
+			optimizeConstants(program);
+		if (config.jumpThreading)
+			optimizeJumpThreading(program);
+		if (config.deadCodeElimination)
+			optimizeDeadCode(program);
+		if (config.jumpThreading)
+			optimizeBlockLayout(program);
+
+		PointerRangeHolder<InstructionEnum> instructions;
+		PointerRangeHolder<uint32> paramsOffsets;
+		PointerRangeHolder<uint32> sourceLines;
+		PointerRangeHolder<uint32> functionIndices;
+		PointerRangeHolder<StepWeight> stepWeights;
+		bool weighted = false;
+		MemoryBuffer paramsBuffer;
+		Serializer ser(paramsBuffer);
+		for (const OptimizerInstruction &ins : program)
+		{
+			instructions.push_back(ins.opcode);
+			paramsOffsets.push_back(numeric_cast<uint32>(paramsBuffer.size()));
+			sourceLines.push_back(ins.sourceLine);
+			functionIndices.push_back(ins.functionIndex);
+			stepWeights.push_back(ins.weight);
+			weighted |= ins.weight.steps != 0 || ins.weight.jumpSteps != 0;
+			const char *operands = instructionInfo(ins.opcode).operands;
+			for (uint32 j = 0; operands[j]; j++)
+			{
+				if (operandSize(operands[j]) == 4)
+					ser << ins.operands[j];
+				else
+					ser << numeric_cast<uint8>(ins.operands[j]);
+			}
+		}
+
+		ProgramSections optimized = sections;
+		optimized.instructions = instructions;
+		optimized.paramsOffsets = paramsOffsets;
+		optimized.sourceLines = sourceLines;
+		optimized.functionIndices = functionIndices;
+		optimized.params = paramsBuffer;
+		if (weighted)
+			optimized.stepWeights = stepWeights;
+		return programSerialize(optimized, true);
+	}
+}
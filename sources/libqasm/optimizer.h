@@ -0,0 +1,38 @@
+#ifndef optimizer_h_k4j5h6g7s
+#define optimizer_h_k4j5h6g7s
+
+#include "program.h"
+
+#include <vector>
+
+namespace qasm
+{
+	// instruction with decoded parameters, as manipulated by the optimization passes
+	struct OptimizerInstruction
+	{
+		InstructionEnum opcode = InstructionEnum::nop;
+		uint32 operands[3] = {}; // in order of InstructionInfo::operands
+		uint32 sourceLine = 0;
+		uint32 functionIndex = 0;
+		StepWeight weight;
+	};
+
+	using OptimizerProgram = std::vector<OptimizerInstruction>;
+
+	OptimizerProgram optimizerDecode(const ProgramSections &sections);
+
+	// keeps only the listed instructions, in the given order, and updates jump and call targets accordingly
+	void optimizerRearrange(OptimizerProgram &program, const std::vector<uint32> &order);
+
+	// passes
+	void optimizeConstants(OptimizerProgram &program);
+	void optimizeDeadCode(OptimizerProgram &program);
+	void optimizeJumpThreading(OptimizerProgram &program);
+	void optimizeBlockLayout(OptimizerProgram &program);
+	void optimizeInlining(OptimizerProgram &program);
+
+	// runs all passes enabled in the config and returns serialized program
+	MemoryBuffer programOptimize(const CompilerCreateConfig &config, const ProgramSections &sections);
+}
+
+#endif // optimizer_h_k4j5h6g7s
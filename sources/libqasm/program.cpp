@@ -1,9 +1,152 @@
-#include <cage-core/lineReader.h>
+#include <cage-core/pointerRangeHolder.h>
+#include <cage-core/math.h> // min
 
 #include "program.h"
 
 namespace qasm
 {
+	namespace
+	{
+		struct Section
+		{
+			uint64 offset = 0; // bytes from the beginning of the buffer
+			uint64 size = 0; // bytes
+		};
+
+		enum SectionsEnum
+		{
+			SectionInstructions,
+			SectionParamsOffsets,
+			SectionSourceLines,
+			SectionFunctionIndices,
+			SectionParams,
+			SectionFunctionNames,
+			SectionStepWeights,
+			SectionMemoryData,
+			SectionMemoryDataValues,
+			SectionSourceCode,
+			SectionSourceCodeLines,
+			SectionsCount,
+		};
+
+		struct Header
+		{
+			char magic[8] = { 'q', 'a', 's', 'm', 'p', 'r', 'g', 0 };
+			uint32 version = ProgramFormatVersion;
+			uint32 flags = 0; // reserved
+			Section sections[SectionsCount];
+		};
+
+		constexpr uintPtr SectionAlignment = 8;
+
+		uintPtr alignUp(uintPtr offset)
+		{
+			return (offset + SectionAlignment - 1) / SectionAlignment * SectionAlignment;
+		}
+
+		template<class T>
+		PointerRange<const char> bytes(PointerRange<const T> range)
+		{
+			return { (const char *)range.begin(), (const char *)range.end() };
+		}
+
+		template<class T>
+		PointerRange<const T> section(PointerRange<const char> buffer, const Section &s)
+		{
+			if (s.offset % SectionAlignment != 0 || s.size % sizeof(T) != 0)
+				CAGE_THROW_ERROR(Exception, "program buffer has misaligned section");
+			if (s.offset > buffer.size() || s.size > buffer.size() - s.offset)
+				CAGE_THROW_ERROR(Exception, "program buffer section is out of range");
+			const char *b = buffer.begin() + s.offset;
+			return { (const T *)b, (const T *)(b + s.size) };
+		}
+	}
+
+	MemoryBuffer programSerialize(const ProgramSections &sections, bool includeSourceCode)
+	{
+		const PointerRange<const char> data[SectionsCount] = {
+			bytes(sections.instructions),
+			bytes(sections.paramsOffsets),
+			bytes(sections.sourceLines),
+			bytes(sections.functionIndices),
+			sections.params,
+			bytes(sections.functionNames),
+			bytes(sections.stepWeights),
+			bytes(sections.memoryData),
+			bytes(sections.memoryDataValues),
+			includeSourceCode ? sections.sourceCode : PointerRange<const char>(),
+			includeSourceCode ? bytes(sections.sourceCodeLines) : PointerRange<const char>(),
+		};
+
+		Header header;
+		uintPtr total = alignUp(sizeof(Header));
+		for (uint32 i = 0; i < SectionsCount; i++)
+		{
+			header.sections[i].offset = total;
+			header.sections[i].size = data[i].size();
+			total = alignUp(total + data[i].size());
+		}
+
+		MemoryBuffer buffer(total);
+		buffer.zero();
+		detail::memcpy(buffer.data(), &header, sizeof(header));
+		for (uint32 i = 0; i < SectionsCount; i++)
+			if (!data[i].empty())
+				detail::memcpy(buffer.data() + header.sections[i].offset, data[i].data(), data[i].size());
+		return buffer;
+	}
+
+	ProgramSections programDeserialize(PointerRange<const char> buffer)
+	{
+		if ((uintPtr)buffer.data() % SectionAlignment != 0)
+			CAGE_THROW_ERROR(Exception, "program buffer is misaligned");
+		if (buffer.size() < sizeof(Header))
+			CAGE_THROW_ERROR(Exception, "program buffer is too small");
+		const Header &header = *(const Header *)buffer.data();
+		if (detail::memcmp(header.magic, Header().magic, sizeof(header.magic)) != 0)
+			CAGE_THROW_ERROR(Exception, "program buffer has invalid magic");
+		if (header.version != ProgramFormatVersion)
+			CAGE_THROW_ERROR(Exception, "program buffer has unsupported version");
+
+		ProgramSections s;
+		s.instructions = section<InstructionEnum>(buffer, header.sections[SectionInstructions]);
+		s.paramsOffsets = section<uint32>(buffer, header.sections[SectionParamsOffsets]);
+		s.sourceLines = section<uint32>(buffer, header.sections[SectionSourceLines]);
+		s.functionIndices = section<uint32>(buffer, header.sections[SectionFunctionIndices]);
+		s.params = section<char>(buffer, header.sections[SectionParams]);
+		s.functionNames = section<FunctionNameRecord>(buffer, header.sections[SectionFunctionNames]);
+		s.stepWeights = section<StepWeight>(buffer, header.sections[SectionStepWeights]);
+		s.memoryData = section<MemoryDataRecord>(buffer, header.sections[SectionMemoryData]);
+		s.memoryDataValues = section<uint32>(buffer, header.sections[SectionMemoryDataValues]);
+		s.sourceCode = section<char>(buffer, header.sections[SectionSourceCode]);
+		s.sourceCodeLines = section<SourceLineRecord>(buffer, header.sections[SectionSourceCodeLines]);
+
+		const uintPtr count = s.instructions.size();
+		if (count == 0 || s.paramsOffsets.size() != count || s.sourceLines.size() != count || s.functionIndices.size() != count || (!s.stepWeights.empty() && s.stepWeights.size() != count))
+			CAGE_THROW_ERROR(Exception, "program buffer has inconsistent sections");
+		if (s.functionNames.empty())
+			CAGE_THROW_ERROR(Exception, "program buffer has no functions");
+		for (uintPtr i = 0; i < count; i++)
+		{
+			if (s.instructions[i] > InstructionEnum::disabled)
+				CAGE_THROW_ERROR(Exception, "program buffer has invalid instruction");
+			if (s.paramsOffsets[i] > s.params.size())
+				CAGE_THROW_ERROR(Exception, "program buffer has invalid parameters offset");
+			if (s.functionIndices[i] >= s.functionNames.size())
+				CAGE_THROW_ERROR(Exception, "program buffer has invalid function index");
+		}
+		for (const FunctionNameRecord &n : s.functionNames)
+			if (n.length > sizeof(n.value))
+				CAGE_THROW_ERROR(Exception, "program buffer has invalid function name");
+		for (const MemoryDataRecord &d : s.memoryData)
+			if (d.pool >= 26 || d.offset > s.memoryDataValues.size() || d.count > s.memoryDataValues.size() - d.offset || uint64(d.address) + d.count > uint32(m))
+				CAGE_THROW_ERROR(Exception, "program buffer has invalid memory data");
+		for (const SourceLineRecord &l : s.sourceCodeLines)
+			if (l.offset > s.sourceCode.size() || l.length > s.sourceCode.size() - l.offset)
+				CAGE_THROW_ERROR(Exception, "program buffer has invalid source code line");
+		return s;
+	}
+
 	uint32 Program::instructionsCount() const
 	{
 		const ProgramImpl *impl = (const ProgramImpl *)this;
@@ -15,7 +158,8 @@ namespace qasm
 		const ProgramImpl *impl = (const ProgramImpl *)this;
 		if (index >= impl->functionNames.size())
 			CAGE_THROW_ERROR(Exception, "program function index out of range");
-		return impl->functionNames[index];
+		const FunctionNameRecord &n = impl->functionNames[index];
+		return detail::StringBase<20>(PointerRange<const char>(n.value, n.value + n.length));
 	}
 
 	PointerRange<const char> Program::sourceCode() const
@@ -27,10 +171,31 @@ namespace qasm
 	string Program::sourceCodeLine(uint32 index) const
 	{
 		const ProgramImpl *impl = (const ProgramImpl *)this;
-		Holder<LineReader> reader = newLineReader(impl->sourceCode);
-		string line;
-		while (index--)
-			reader->readLine(line);
-		return line;
+		if (index >= impl->sourceCodeLines.size())
+			return "";
+		const SourceLineRecord &l = impl->sourceCodeLines[index];
+		const char *b = impl->sourceCode.begin() + l.offset;
+		return string(PointerRange<const char>(b, b + min(l.length, uint32(string::MaxLength))));
+	}
+
+	Holder<PointerRange<char>> Program::exportBuffer(bool includeSourceCode) const
+	{
+		const ProgramImpl *impl = (const ProgramImpl *)this;
+		MemoryBuffer buffer = programSerialize(*impl, includeSourceCode);
+		return PointerRangeHolder<char>(PointerRange<const char>(buffer));
+	}
+
+	const ProgramAnalysis &Program::analysis() const
+	{
+		const ProgramImpl *impl = (const ProgramImpl *)this;
+		std::call_once(impl->analysisFlag, [impl]() { impl->analysisCache = programAnalyze(*impl); });
+		return *impl->analysisCache;
+	}
+
+	Holder<Program> newProgram(PointerRange<const char> buffer)
+	{
+		Holder<ProgramImpl> p = detail::systemArena().createHolder<ProgramImpl>();
+		(ProgramSections &)*p = programDeserialize(buffer);
+		return templates::move(p).cast<Program>();
 	}
 }
@@ -1,5 +1,12 @@
+#ifndef program_h_s5d4f6g8h
+#define program_h_s5d4f6g8h
+
+#include <cage-core/memoryBuffer.h>
+
 #include <qasm/qasm.h>
 
+#include <mutex>
+
 namespace qasm
 {
 	enum class InstructionEnum : uint16
@@ -170,12 +177,68 @@ namespace qasm
 		wreset,      //
 		wclear,      //
 		rwswap,      //
+		readall,     // Q/M
+		ireadall,    // Q/M
+		freadall,    // Q/M
+		readlns,     // Q/M
+		ireadlns,    // Q/M
+		freadlns,    // Q/M
+		writeall,    // M
+		iwriteall,   // M
+		fwriteall,   // M
+		bread,       // R
+		bwrite,      // R
+		bmread,      // M
+		bmwrite,     // M
 
 		// random
 		rand,        // R
 		irand,       // R
 		frand,       // R
 
+		// immediate operand forms (produced by the optimizer only)
+		addimm,      // R R uint32
+		subimm,      // R R uint32
+		mulimm,      // R R uint32
+		divimm,      // R R uint32
+		modimm,      // R R uint32
+		iaddimm,     // R R uint32
+		isubimm,     // R R uint32
+		imulimm,     // R R uint32
+		idivimm,     // R R uint32
+		imodimm,     // R R uint32
+		shlimm,      // R R uint32
+		shrimm,      // R R uint32
+		bandimm,     // R R uint32
+		borimm,      // R R uint32
+		bxorimm,     // R R uint32
+		faddimm,     // R R uint32
+		fsubimm,     // R R uint32
+		fmulimm,     // R R uint32
+		fdivimm,     // R R uint32
+		eqimm,       // R R uint32
+		neqimm,      // R R uint32
+		ltimm,       // R R uint32
+		gtimm,       // R R uint32
+		lteimm,      // R R uint32
+		gteimm,      // R R uint32
+		ieqimm,      // R R uint32
+		ineqimm,     // R R uint32
+		iltimm,      // R R uint32
+		igtimm,      // R R uint32
+		ilteimm,     // R R uint32
+		igteimm,     // R R uint32
+		feqimm,      // R R uint32
+		fneqimm,     // R R uint32
+		fltimm,      // R R uint32
+		fgtimm,      // R R uint32
+		flteimm,     // R R uint32
+		fgteimm,     // R R uint32
+
+		// verified forms (produced by the cpu when loading a program, never stored in programs)
+		vmload,      // R M uint32
+		vmstore,     // M uint32 R
+
 		// miscellaneous
 		profiling,   // bool
 		tracing,     // bool
@@ -184,19 +247,84 @@ namespace qasm
 		terminate,   //
 		unreachable, //
 		disabled,    //
+
+		// more verified forms, placed after all instructions that may be stored in programs, so that adding them does not renumber those
+		vcall,       // uint32
+		vcondcall,   // uint32
+		vreturn,     //
+		vcondreturn, //
+		vguard,      // R uint32
+		vindload,    // R M
+		vindstore,   // M R
+		vsstat,      // S
+		vqstat,      // Q
+		vtstat,      // T
+		vmstat,      // M
+		vrstat,      //
 	};
 
-	struct ProgramImpl : public Program
+	// fixed size record of function name as stored in serialized program
+	struct FunctionNameRecord
 	{
-		Holder<PointerRange<InstructionEnum>> instructions;
-		Holder<PointerRange<uint32>> paramsOffsets;
-		Holder<PointerRange<uint32>> sourceLines;
-		Holder<PointerRange<uint32>> functionIndices;
+		uint32 length = 0;
+		char value[20] = {};
+	};
 
-		Holder<PointerRange<const char>> params;
-		Holder<PointerRange<detail::StringBase<20>>> functionNames;
+	// position of one line in the source code, without the line end
+	struct SourceLineRecord
+	{
+		uint32 offset = 0;
+		uint32 length = 0;
+	};
+
+	// additional steps counted for an instruction, compensating for instructions removed by the optimizer
+	struct StepWeight
+	{
+		uint32 steps = 0; // counted whenever the instruction completes
+		uint32 jumpSteps = 0; // counted additionally when the instruction transfers control to its target
+	};
 
-		Holder<PointerRange<const char>> sourceCode; // copy of source code
-		uint32 linesCount = 0;
+	// initial contents of a range of a memory pool, copied into the pool when the program starts
+	struct MemoryDataRecord
+	{
+		uint32 pool = 0;
+		uint32 address = 0; // first cell in the pool
+		uint32 offset = 0; // first value in the memory data values
+		uint32 count = 0;
 	};
+
+	// views of all parts of a program
+	// when loaded, they point directly into the serialized buffer
+	struct ProgramSections
+	{
+		PointerRange<const InstructionEnum> instructions;
+		PointerRange<const uint32> paramsOffsets;
+		PointerRange<const uint32> sourceLines;
+		PointerRange<const uint32> functionIndices;
+
+		PointerRange<const char> params;
+		PointerRange<const FunctionNameRecord> functionNames;
+		PointerRange<const StepWeight> stepWeights; // empty if every instruction counts as one step
+		PointerRange<const MemoryDataRecord> memoryData; // in order of the source code, later records overwrite earlier ones
+		PointerRange<const uint32> memoryDataValues;
+
+		PointerRange<const char> sourceCode; // may be empty
+		PointerRange<const SourceLineRecord> sourceCodeLines; // index of lines in the source code, empty together with the source code
+	};
+
+	struct ProgramImpl : public Program, public ProgramSections
+	{
+		using ProgramSections::sourceCode; // hide Program::sourceCode()
+
+		MemoryBuffer storage; // owned serialized program, empty if the program uses external buffer
+
+		mutable std::once_flag analysisFlag;
+		mutable Holder<ProgramAnalysis> analysisCache;
+	};
+
+	MemoryBuffer programSerialize(const ProgramSections &sections, bool includeSourceCode);
+	ProgramSections programDeserialize(PointerRange<const char> buffer);
+	Holder<ProgramAnalysis> programAnalyze(const ProgramSections &sections);
 }
+
+#endif // program_h_s5d4f6g8h
@@ -0,0 +1,381 @@
+#include <cage-core/serialization.h>
+#include <cage-core/string.h>
+
+#include "verifier.h"
+#include "instructions.h"
+
+namespace qasm
+{
+	namespace
+	{
+		constexpr const char *StructureNames[4] = { "stack", "queue", "tape", "memory pool" };
+
+		// 0 = stack, 1 = queue, 2 = tape, 3 = memory pool (same as the structure type operand)
+		uint32 structureType(char operand)
+		{
+			switch (operand)
+			{
+			case 'S': return 0;
+			case 'Q': return 1;
+			case 'T': return 2;
+			default: return 3;
+			}
+		}
+
+		// structures of the type may be exchanged at runtime, their properties are not known statically
+		uint32 swappedType(InstructionEnum instruction)
+		{
+			switch (instruction)
+			{
+			case InstructionEnum::sswap:
+			case InstructionEnum::indsswap:
+				return 0;
+			case InstructionEnum::qswap:
+			case InstructionEnum::indqswap:
+				return 1;
+			case InstructionEnum::tswap:
+			case InstructionEnum::indtswap:
+				return 2;
+			case InstructionEnum::mswap:
+			case InstructionEnum::indmswap:
+				return 3;
+			default:
+				return m;
+			}
+		}
+
+		// stat instructions are valid on disabled structures too
+		bool isStat(InstructionEnum instruction)
+		{
+			switch (instruction)
+			{
+			case InstructionEnum::sstat:
+			case InstructionEnum::qstat:
+			case InstructionEnum::tstat:
+			case InstructionEnum::mstat:
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		// accesses memory pool chosen at runtime
+		bool accessesAnyMemory(InstructionEnum instruction)
+		{
+			switch (instruction)
+			{
+			case InstructionEnum::indindload:
+			case InstructionEnum::indindstore:
+			case InstructionEnum::indmswap:
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		bool writesMemory(InstructionEnum instruction)
+		{
+			switch (instruction)
+			{
+			case InstructionEnum::mstore:
+			case InstructionEnum::indstore:
+			case InstructionEnum::readall:
+			case InstructionEnum::ireadall:
+			case InstructionEnum::freadall:
+			case InstructionEnum::readlns:
+			case InstructionEnum::ireadlns:
+			case InstructionEnum::freadlns:
+			case InstructionEnum::bmread:
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		bool isVerifiedForm(InstructionEnum instruction)
+		{
+			switch (instruction)
+			{
+			case InstructionEnum::vmload:
+			case InstructionEnum::vmstore:
+			case InstructionEnum::vcall:
+			case InstructionEnum::vcondcall:
+			case InstructionEnum::vreturn:
+			case InstructionEnum::vcondreturn:
+			case InstructionEnum::vguard:
+			case InstructionEnum::vindload:
+			case InstructionEnum::vindstore:
+			case InstructionEnum::vsstat:
+			case InstructionEnum::vqstat:
+			case InstructionEnum::vtstat:
+			case InstructionEnum::vmstat:
+			case InstructionEnum::vrstat:
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		// a return may be executed in the program scope, with empty callstack
+		bool entryMayReturn(const ProgramImpl *program, const ProgramAnalysis &analysis)
+		{
+			std::vector<bool> visited;
+			visited.resize(analysis.blocks().size(), false);
+			std::vector<uint32> worklist;
+			worklist.push_back(0);
+			visited[0] = true;
+			while (!worklist.empty())
+			{
+				const uint32 b = worklist.back();
+				worklist.pop_back();
+				const ProgramBlock &block = analysis.blocks()[b];
+				const InstructionEnum last = program->instructions[block.firstInstruction + block.instructionsCount - 1];
+				if (last == InstructionEnum::return_ || last == InstructionEnum::condreturn)
+					return true;
+				for (const uint32 s : analysis.successors(b))
+				{
+					if (!visited[s])
+					{
+						visited[s] = true;
+						worklist.push_back(s);
+					}
+				}
+			}
+			return false;
+		}
+
+		// the next instruction is executed after this one, at least sometimes
+		bool fallsThrough(InstructionEnum instruction)
+		{
+			switch (instruction)
+			{
+			case InstructionEnum::jump:
+			case InstructionEnum::return_:
+			case InstructionEnum::exit:
+			case InstructionEnum::terminate:
+			case InstructionEnum::unreachable:
+			case InstructionEnum::disabled:
+				return false;
+			default:
+				return true;
+			}
+		}
+	}
+
+	VerifiedProgram programVerify(const ProgramImpl *program, const CpuLimitsConfig &limits)
+	{
+		const uint32 count = numeric_cast<uint32>(program->instructions.size());
+		VerifiedProgram verified;
+		verified.instructions = std::vector<InstructionEnum>(program->instructions.begin(), program->instructions.end());
+		std::vector<InstructionEnum> &result = verified.instructions;
+
+		bool swapped[4] = {};
+		for (const InstructionEnum ins : result)
+		{
+			if (ins > InstructionEnum::disabled)
+				CAGE_THROW_ERROR(Exception, "program has invalid instruction");
+			if (isVerifiedForm(ins))
+				CAGE_THROW_ERROR(Exception, "program has internal instruction");
+			const uint32 t = swappedType(ins);
+			if (t != m)
+				swapped[t] = true;
+			if (accessesAnyMemory(ins))
+				verified.memoriesUsed = (1u << 26) - 1;
+		}
+		if (fallsThrough(result.back()))
+			CAGE_THROW_ERROR(Exception, "program may continue past its last instruction");
+
+		// initial contents of memory pools must fit, otherwise the program cannot start
+		for (const MemoryDataRecord &d : program->memoryData)
+		{
+			if (d.pool >= limits.memoriesCount)
+			{
+				CAGE_LOG_THROW(stringizer() + "memory pool: " + d.pool);
+				CAGE_THROW_ERROR(Exception, "program has data for disabled memory pool");
+			}
+			if (uint64(d.address) + d.count > limits.memoryCapacity[d.pool])
+			{
+				CAGE_LOG_THROW(stringizer() + "memory pool: " + d.pool);
+				CAGE_LOG_THROW(stringizer() + "capacity: " + limits.memoryCapacity[d.pool]);
+				CAGE_THROW_ERROR(Exception, "program data exceed capacity of memory pool");
+			}
+			verified.memoriesUsed |= 1u << d.pool;
+		}
+
+		const uint32 counts[4] = { limits.stacksCount, limits.queuesCount, limits.tapesCount, limits.memoriesCount };
+		const std::bitset<InstructionsCount> disabled = instructionsMask(limits.disabledInstructions);
+		const auto &warning = [&](uint32 index, const string &message) {
+			CAGE_LOG(SeverityEnum::Warning, "qasm", stringizer() + "line " + (program->sourceLines[index] + 1) + ": " + message);
+		};
+
+		for (uint32 i = 0; i < count; i++)
+		{
+			const InstructionEnum ins = result[i];
+			const bool isDisabled = disabled[uint32(ins)];
+			const char *operands = instructionInfo(ins).operands;
+			uint32 size = 0;
+			for (uint32 j = 0; operands[j]; j++)
+				size += operandSize(operands[j]);
+			if (uint64(program->paramsOffsets[i]) + size > program->params.size())
+				CAGE_THROW_ERROR(Exception, "program has truncated instruction parameters");
+
+			Deserializer des(program->params);
+			des.advance(program->paramsOffsets[i]);
+			uint32 values[3] = {};
+			uint32 type = m;
+			for (uint32 j = 0; operands[j]; j++)
+			{
+				CAGE_ASSERT(j < 3);
+				if (operandSize(operands[j]) == 4)
+					des >> values[j];
+				else
+				{
+					uint8 v;
+					des >> v;
+					values[j] = v;
+				}
+
+				const uint32 v = values[j];
+				switch (operands[j])
+				{
+				case 'd':
+				case 'c':
+				case 'r':
+				case 'x':
+					if (v >= 26 + 26)
+						CAGE_THROW_ERROR(Exception, "program has invalid register");
+					break;
+				case 'y':
+					if (v != 1 && v != 3)
+						CAGE_THROW_ERROR(Exception, "program has invalid structure type");
+					type = v;
+					break;
+				case 'S':
+				case 'Q':
+				case 'T':
+				case 'M':
+					type = structureType(operands[j]);
+					[[fallthrough]];
+				case 'k':
+				{
+					if (v >= 26)
+						CAGE_THROW_ERROR(Exception, "program has invalid structure");
+					if (type == 3)
+						verified.memoriesUsed |= 1u << v;
+					if (swapped[type] || isStat(ins) || isDisabled)
+						break;
+					if (v >= counts[type])
+						warning(i, stringizer() + "access to disabled " + StructureNames[type]);
+					else if (type == 3 && limits.memoryReadOnly[v] && writesMemory(ins))
+						warning(i, "write to read only memory pool");
+				} break;
+				case 'l':
+					if (v >= count)
+						CAGE_THROW_ERROR(Exception, "program has invalid jump target");
+					break;
+				}
+			}
+
+			if (isDisabled)
+			{
+				warning(i, stringizer() + "instruction " + instructionName(ins) + " is disabled");
+				result[i] = InstructionEnum::disabled;
+				continue;
+			}
+
+			// constant addresses into pools that cannot be exchanged
+			if ((ins == InstructionEnum::mload || ins == InstructionEnum::mstore) && !swapped[3])
+			{
+				const bool store = ins == InstructionEnum::mstore;
+				const uint32 pool = values[store ? 0 : 1];
+				const uint32 address = values[store ? 1 : 2];
+				if (pool < limits.memoriesCount && !(store && limits.memoryReadOnly[pool]))
+				{
+					if (address < limits.memoryCapacity[pool])
+						result[i] = store ? InstructionEnum::vmstore : InstructionEnum::vmload;
+					else
+						warning(i, "memory address out of bounds");
+				}
+			}
+		}
+
+		// nesting of calls, all paths through the call graph are considered
+		const ProgramAnalysis &analysis = program->analysis();
+		const uint32 depth = analysis.callDepth();
+		const bool boundedCalls = depth <= limits.callstackCapacity;
+		if (depth != m && !boundedCalls)
+			CAGE_LOG(SeverityEnum::Warning, "qasm", stringizer() + "calls may be nested " + depth + " deep, exceeding the callstack capacity");
+		verified.callstackSize = boundedCalls ? depth : limits.callstackCapacity;
+		const bool boundedReturns = !entryMayReturn(program, analysis);
+		for (InstructionEnum &ins : result)
+		{
+			switch (ins)
+			{
+			case InstructionEnum::call:
+				if (boundedCalls)
+					ins = InstructionEnum::vcall;
+				break;
+			case InstructionEnum::condcall:
+				if (boundedCalls)
+					ins = InstructionEnum::vcondcall;
+				break;
+			case InstructionEnum::return_:
+				if (boundedReturns)
+					ins = InstructionEnum::vreturn;
+				break;
+			case InstructionEnum::condreturn:
+				if (boundedReturns)
+					ins = InstructionEnum::vcondreturn;
+				break;
+			default:
+				break;
+			}
+		}
+
+		// stat instructions compute and write only the registers that are read later
+		const std::vector<uint64> live = verifyStats(program, result);
+		for (uint32 i = 0; i < count; i++)
+		{
+			const InstructionEnum ins = result[i];
+			if ((instructionInfo(ins).implicitWrites & ~live[i]) == 0)
+				continue;
+			switch (ins)
+			{
+			case InstructionEnum::sstat: result[i] = InstructionEnum::vsstat; break;
+			case InstructionEnum::qstat: result[i] = InstructionEnum::vqstat; break;
+			case InstructionEnum::tstat: result[i] = InstructionEnum::vtstat; break;
+			case InstructionEnum::mstat: result[i] = InstructionEnum::vmstat; break;
+			case InstructionEnum::rstat: result[i] = InstructionEnum::vrstat; break;
+			default: continue;
+			}
+			if (verified.statRegisters.empty())
+				verified.statRegisters.resize(count, 0);
+			verified.statRegisters[i] = instructionInfo(ins).implicitWrites & live[i];
+		}
+
+		// bounds checks in counted loops are evaluated once, when the loop is entered
+		for (LoopGuard &g : verifyLoops(program, limits, swapped[3]))
+		{
+			if (disabled[uint32(program->instructions[g.instruction])])
+				continue;
+			for (uint32 j = 0; j < g.accesses.size(); j++)
+			{
+				if (disabled[uint32(program->instructions[g.accesses[j].instruction])])
+					g.accesses.erase(g.accesses.begin() + j--);
+			}
+			if (g.accesses.empty())
+				continue;
+			if (g.kernel.type != LoopKernelEnum::None)
+			{
+				const uint32 exit = g.kernel.exit;
+				for (uint32 i = g.instruction + 1; i < exit; i++)
+					if (disabled[uint32(program->instructions[i])])
+						g.kernel = LoopKernel();
+			}
+			result[g.instruction] = InstructionEnum::vguard;
+			verified.loopGuards.push_back(templates::move(g));
+		}
+
+		return verified;
+	}
+}
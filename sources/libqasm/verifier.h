@@ -0,0 +1,77 @@
+#ifndef verifier_h_w8e5r2t6z
+#define verifier_h_w8e5r2t6z
+
+#include "program.h"
+
+#include <vector>
+
+namespace qasm
+{
+	// indirect memory access inside a counted loop, at address base + counter + offset
+	struct LoopAccess
+	{
+		uint32 instruction = m; // indload or indstore
+		uint32 base = 0;
+		uint32 baseRegister = m; // added to the base, if any
+		uint32 pool = 0;
+		uint32 offset = 0; // 1 if the address is computed after the counter was incremented
+		bool store = false;
+	};
+
+	enum class LoopKernelEnum : uint8
+	{
+		None,
+		Fill, // indstore of a register that does not change in the loop
+		Reduce, // indload and accumulation of the loaded values
+		Copy, // indload and indstore of the loaded value
+	};
+
+	// the whole body of the loop is a known idiom, which the cpu executes natively when all accesses are valid
+	struct LoopKernel
+	{
+		LoopKernelEnum type = LoopKernelEnum::None;
+		InstructionEnum operation = InstructionEnum::nop; // accumulation of the reduce kernel
+		uint32 counter = m;
+		uint32 value = m; // register stored or loaded
+		uint32 accumulator = m; // reduce only
+		uint32 exit = m; // instruction following the loop
+		uint32 steps = 0; // per iteration, including step weights
+		uint32 jumpSteps = 0; // step weights of the jump back to the beginning of the loop
+	};
+
+	// evaluated when the instruction, which initializes the loop counter, is executed
+	// chooses between checked and unchecked forms of the accesses in the loop
+	struct LoopGuard
+	{
+		uint32 instruction = m;
+		uint32 start = 0; // initial value of the counter
+		uint32 limit = 0; // the loop continues while the counter is less than the limit
+		uint32 limitRegister = m; // used instead of the limit, if any
+		std::vector<LoopAccess> accesses; // ordered by instruction
+		LoopKernel kernel;
+	};
+
+	struct VerifiedProgram
+	{
+		std::vector<InstructionEnum> instructions; // as they should be dispatched by the cpu
+		uint32 memoriesUsed = 0; // bit mask of memory pools that the program may access, directly or indirectly, or that have initial data
+		uint32 callstackSize = 0; // number of entries to preallocate for the callstack
+		std::vector<LoopGuard> loopGuards; // ordered by instruction
+		std::vector<uint64> statRegisters; // registers written by the specialized stat instructions, indexed by instruction, empty if there are none
+	};
+
+	// validates the program and prepares it for a cpu with the given limits
+	// throws if the program is malformed (eg. damaged exported buffer), or if its memory data do not fit the pools
+	// logs warnings for instructions that are certain to fail with the given limits
+	// memory accesses, calls and returns proven to be valid are replaced by verified forms, which skip the checks at runtime
+	VerifiedProgram programVerify(const ProgramImpl *program, const CpuLimitsConfig &limits);
+
+	// range analysis of counted loops with indirect memory accesses
+	std::vector<LoopGuard> verifyLoops(const ProgramImpl *program, const CpuLimitsConfig &limits, bool memoriesSwapped);
+
+	// liveness of the registers written by stat instructions
+	// returns, for each instruction, the registers that may be read before they are overwritten (all registers for other instructions)
+	std::vector<uint64> verifyStats(const ProgramImpl *program, PointerRange<const InstructionEnum> instructions);
+}
+
+#endif // verifier_h_w8e5r2t6z
@@ -0,0 +1,217 @@
+#include "verifier.h"
+#include "optimizer.h"
+#include "instructions.h"
+
+namespace qasm
+{
+	namespace
+	{
+		constexpr uint64 AllRegisters = (uint64(1) << (26 + 26)) - 1;
+		constexpr uint32 AddressRegister = implicitRegister('i');
+		constexpr uint32 ConditionRegister = implicitRegister('z');
+
+		constexpr uint64 bit(uint32 reg)
+		{
+			return uint64(1) << reg;
+		}
+
+		// registers that the instruction may write to, including conditionally
+		uint64 writtenRegisters(const OptimizerInstruction &ins)
+		{
+			const InstructionInfo info = instructionInfo(ins.opcode);
+			if (info.writesAnyRegister)
+				return AllRegisters;
+			uint64 res = info.implicitWrites;
+			for (uint32 j = 0; info.operands[j]; j++)
+				if (info.operands[j] == 'd' || info.operands[j] == 'c' || info.operands[j] == 'x')
+					res |= bit(ins.operands[j]);
+			return res;
+		}
+
+		// describes how the address of the access is computed from the counter, returns false if it is not known
+		bool addressOf(const OptimizerInstruction &ins, uint32 counter, uint64 written, LoopAccess &access)
+		{
+			if (ins.operands[0] != AddressRegister)
+				return false;
+			switch (ins.opcode)
+			{
+			case InstructionEnum::copy:
+				return ins.operands[1] == counter;
+			case InstructionEnum::addimm:
+				access.base = ins.operands[2];
+				return ins.operands[1] == counter;
+			case InstructionEnum::add:
+			{
+				if ((ins.operands[1] == counter) == (ins.operands[2] == counter))
+					return false;
+				access.baseRegister = ins.operands[1] == counter ? ins.operands[2] : ins.operands[1];
+				return (written & bit(access.baseRegister)) == 0;
+			}
+			default:
+				return false;
+			}
+		}
+
+		// accumulations that give same results when evaluated in a native loop
+		bool isAccumulation(InstructionEnum instruction, bool mirrored)
+		{
+			switch (instruction)
+			{
+			case InstructionEnum::add:
+			case InstructionEnum::iadd:
+			case InstructionEnum::mul:
+			case InstructionEnum::imul:
+			case InstructionEnum::band:
+			case InstructionEnum::bor:
+			case InstructionEnum::bxor:
+				return true;
+			case InstructionEnum::fadd:
+			case InstructionEnum::fmul:
+				return !mirrored; // the order of operands matters for nan values
+			default:
+				return false;
+			}
+		}
+
+		// the body, without the increment and the comparison, is one of:
+		//   <address> indstore M R
+		//   <address> indload V M, <op> S S V
+		//   <address> indload V M, [<address>] indstore M V
+		// where all addresses are described by the accesses, and V and S are not used otherwise
+		LoopKernel findKernel(const OptimizerProgram &code, uint32 first, uint32 last, uint32 counter, uint32 increment, uint64 written, const LoopGuard &guard)
+		{
+			LoopKernel k;
+			const uint32 size = increment - first;
+			if (increment != last - 2 || size < 2 || size > 4 || guard.accesses[0].instruction != first + 1)
+				return k;
+			const auto &reserved = [&](uint32 reg) {
+				return reg == AddressRegister || reg == ConditionRegister || reg == counter;
+			};
+			const OptimizerInstruction &a = code[first + 1];
+			const OptimizerInstruction &b = code[increment - 1];
+			if (size == 2 && guard.accesses.size() == 1 && a.opcode == InstructionEnum::indstore && !reserved(a.operands[1]) && (written & bit(a.operands[1])) == 0)
+			{
+				k.type = LoopKernelEnum::Fill;
+				k.value = a.operands[1];
+			}
+			else if (a.opcode == InstructionEnum::indload && !reserved(a.operands[0]))
+			{
+				k.value = a.operands[0];
+				if (size == 3 && guard.accesses.size() == 1 && b.operands[0] == b.operands[1] && b.operands[2] == k.value && isAccumulation(b.opcode, false))
+					k.accumulator = b.operands[0];
+				else if (size == 3 && guard.accesses.size() == 1 && b.operands[0] == b.operands[2] && b.operands[1] == k.value && isAccumulation(b.opcode, true))
+					k.accumulator = b.operands[0];
+				if (k.accumulator != m && k.accumulator != k.value && !reserved(k.accumulator))
+				{
+					k.type = LoopKernelEnum::Reduce;
+					k.operation = b.opcode;
+				}
+				else if (guard.accesses.size() == 2 && guard.accesses[1].instruction == increment - 1 && b.opcode == InstructionEnum::indstore && b.operands[1] == k.value && (size == 3 || (size == 4 && writtenRegisters(code[first + 2]) == bit(AddressRegister))))
+					k.type = LoopKernelEnum::Copy;
+			}
+			if (k.type == LoopKernelEnum::None)
+				return k;
+
+			k.counter = counter;
+			k.exit = last + 1;
+			k.steps = last - first + 1;
+			for (uint32 i = first; i <= last; i++)
+				k.steps += code[i].weight.steps;
+			k.jumpSteps = code[last].weight.jumpSteps;
+			return k;
+		}
+	}
+
+	// finds loops in form:
+	//   set I <start>
+	//   label Loop
+	//   ... (add i P I, indload/indstore using i, exactly one inc I)
+	//   lt z I C
+	//   condjmp Loop
+	// where the loop is a single block entered only from the set instruction, and P and C do not change in the loop
+	// the counter takes values from start up to C - 1, therefore all addresses are known when the loop is entered
+	std::vector<LoopGuard> verifyLoops(const ProgramImpl *program, const CpuLimitsConfig &limits, bool memoriesSwapped)
+	{
+		std::vector<LoopGuard> guards;
+		if (memoriesSwapped)
+			return guards;
+
+		const OptimizerProgram code = optimizerDecode(*program);
+		const ProgramAnalysis &analysis = program->analysis();
+		const PointerRange<const ProgramBlock> blocks = analysis.blocks();
+		for (uint32 b = 0; b < blocks.size(); b++)
+		{
+			const uint32 first = blocks[b].firstInstruction;
+			const uint32 last = first + blocks[b].instructionsCount - 1;
+			if (first == 0 || blocks[b].instructionsCount < 4)
+				continue;
+			if (code[last].opcode != InstructionEnum::condjmp || code[last].operands[0] != first)
+				continue;
+			const PointerRange<const uint32> predecessors = analysis.predecessors(b);
+			const uint32 preheader = analysis.blockIndex(first - 1);
+			if (predecessors.size() != 2 || !((predecessors[0] == b && predecessors[1] == preheader) || (predecessors[0] == preheader && predecessors[1] == b)))
+				continue;
+
+			const OptimizerInstruction &init = code[first - 1];
+			const OptimizerInstruction &compare = code[last - 1];
+			if (init.opcode != InstructionEnum::set)
+				continue;
+			const uint32 counter = init.operands[0];
+			if (counter == ConditionRegister || compare.operands[0] != ConditionRegister || compare.operands[1] != counter)
+				continue;
+			LoopGuard guard;
+			guard.instruction = first - 1;
+			guard.start = init.operands[1];
+			if (compare.opcode == InstructionEnum::lt && compare.operands[2] != counter)
+				guard.limitRegister = compare.operands[2];
+			else if (compare.opcode == InstructionEnum::ltimm)
+				guard.limit = compare.operands[2];
+			else
+				continue;
+
+			// the counter is incremented exactly once per iteration and the limit does not change
+			uint64 written = writtenRegisters(compare);
+			uint32 increment = m;
+			bool valid = true;
+			for (uint32 i = first; i < last - 1; i++)
+			{
+				const uint64 w = writtenRegisters(code[i]);
+				if (w & bit(counter))
+				{
+					valid &= code[i].opcode == InstructionEnum::inc && increment == m;
+					increment = i;
+				}
+				written |= w;
+			}
+			if (!valid || increment == m || (guard.limitRegister != m && (written & bit(guard.limitRegister))))
+				continue;
+
+			for (uint32 i = first; i < last - 1; i++)
+			{
+				const bool store = code[i].opcode == InstructionEnum::indstore;
+				if (code[i].opcode != InstructionEnum::indload && !store)
+					continue;
+				LoopAccess access;
+				access.instruction = i;
+				access.pool = code[i].operands[store ? 0 : 1];
+				access.store = store;
+				if (access.pool >= limits.memoriesCount || (store && limits.memoryReadOnly[access.pool]))
+					continue; // always fails, keep the checks to report it
+				uint32 a = i;
+				while (a > first && (writtenRegisters(code[a - 1]) & bit(AddressRegister)) == 0)
+					a--;
+				if (a == first)
+					continue; // the address comes from previous iteration or from outside the loop
+				a--;
+				access.offset = a > increment;
+				if (addressOf(code[a], counter, written, access))
+					guard.accesses.push_back(access);
+			}
+			if (guard.accesses.empty())
+				continue;
+			guard.kernel = findKernel(code, first, last, counter, increment, written, guard);
+			guards.push_back(guard);
+		}
+		return guards;
+	}
+}
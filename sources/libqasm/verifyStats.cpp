@@ -0,0 +1,84 @@
+#include "verifier.h"
+#include "optimizer.h"
+#include "instructions.h"
+
+namespace qasm
+{
+	namespace
+	{
+		constexpr uint64 AllRegisters = (uint64(1) << (26 + 26)) - 1;
+
+		bool isStat(InstructionEnum instruction)
+		{
+			switch (instruction)
+			{
+			case InstructionEnum::sstat:
+			case InstructionEnum::qstat:
+			case InstructionEnum::tstat:
+			case InstructionEnum::mstat:
+			case InstructionEnum::rstat:
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		// the program stops here, and the host may inspect all registers
+		bool stops(InstructionEnum instruction, bool programScope)
+		{
+			switch (instruction)
+			{
+			case InstructionEnum::breakpoint:
+			case InstructionEnum::exit:
+			case InstructionEnum::terminate:
+			case InstructionEnum::unreachable:
+			case InstructionEnum::disabled:
+				return true;
+			case InstructionEnum::return_:
+			case InstructionEnum::condreturn:
+				return programScope;
+			default:
+				return false;
+			}
+		}
+	}
+
+	// the liveness from the program analysis is refined to individual instructions, walking each block backwards
+	std::vector<uint64> verifyStats(const ProgramImpl *program, PointerRange<const InstructionEnum> instructions)
+	{
+		std::vector<uint64> live;
+		live.resize(instructions.size(), AllRegisters);
+		const OptimizerProgram code = optimizerDecode(*program);
+		for (const ProgramBlock &block : program->analysis().blocks())
+		{
+			uint64 after = block.liveOut;
+			for (uint32 i = block.firstInstruction + block.instructionsCount; i-- > block.firstInstruction;)
+			{
+				if (stops(instructions[i], block.function == 0 || block.function == m))
+				{
+					after = AllRegisters;
+					continue;
+				}
+				const OptimizerInstruction &ins = code[i];
+				const InstructionInfo info = instructionInfo(ins.opcode);
+				uint64 reads = info.implicitReads, writes = info.implicitWrites;
+				for (uint32 j = 0; info.operands[j]; j++)
+				{
+					const uint64 bit = uint64(1) << ins.operands[j];
+					switch (info.operands[j])
+					{
+					case 'r': reads |= bit; break;
+					case 'x': reads |= bit; writes |= bit; break;
+					case 'd': writes |= bit; break;
+					}
+				}
+				if (info.writesAnyRegister)
+					reads = AllRegisters;
+				if (isStat(ins.opcode))
+					live[i] = after;
+				after = (after & ~writes) | reads;
+			}
+		}
+		return live;
+	}
+}
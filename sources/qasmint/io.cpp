@@ -1,25 +1,182 @@
 #include <cage-core/files.h>
 #include <cage-core/lineReader.h>
+#include <cage-core/concurrent.h>
+#include <cage-core/math.h>
 
 #include "io.h"
 
 #include <iostream>
 #include <string>
+#include <atomic>
+#include <cstdio>
+
+#ifdef CAGE_SYSTEM_WINDOWS
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+namespace
+{
+	// lock-free queue of lines with single producer thread and single consumer thread
+	// a thread that cannot continue blocks on the conditional variable, which is signaled only if the other thread is waiting
+	struct LineQueue : private Immovable
+	{
+		static constexpr uint32 Capacity = 256; // must be power of two
+		static_assert((Capacity & (Capacity - 1)) == 0);
+
+		string lines[Capacity];
+		std::atomic<uint32> head = 0; // index of next line to pop, modified by the consumer only
+		std::atomic<uint32> tail = 0; // index of next line to push, modified by the producer only
+		std::atomic<bool> finished = false; // no more lines will be pushed
+		std::atomic<bool> stopping = false; // no more lines will be popped
+		std::atomic<bool> failed = false;
+		std::atomic<uint32> waiting = 0;
+		Holder<Mutex> mutex = newMutex();
+		Holder<ConditionalVariableBase> cond = newConditionalVariableBase();
+
+		bool tryPush(const string &line)
+		{
+			const uint32 t = tail.load(std::memory_order_relaxed);
+			if (t - head.load(std::memory_order_acquire) == Capacity)
+				return false;
+			lines[t % Capacity] = line;
+			tail.store(t + 1, std::memory_order_release);
+			return true;
+		}
+
+		bool tryPop(string &line)
+		{
+			const uint32 h = head.load(std::memory_order_relaxed);
+			if (tail.load(std::memory_order_acquire) == h)
+				return false;
+			line = lines[h % Capacity];
+			head.store(h + 1, std::memory_order_release);
+			return true;
+		}
+
+		// pushes the line, waits while the queue is full, returns false if the consumer has stopped or failed
+		bool push(const string &line)
+		{
+			while (!tryPush(line))
+			{
+				if (stopping || failed)
+					return false;
+				wait([&]() { return tail - head != Capacity || stopping || failed; });
+			}
+			notify();
+			return true;
+		}
+
+		// pops next line, waits while the queue is empty, returns false if there are no more lines
+		bool pop(string &line)
+		{
+			while (true)
+			{
+				const bool last = finished; // must be read before trying to pop
+				if (tryPop(line))
+				{
+					notify();
+					return true;
+				}
+				if (last)
+					return false;
+				wait([&]() { return tail != head || finished; });
+			}
+		}
+
+		// sets the flag and wakes the other thread
+		void signal(std::atomic<bool> &flag)
+		{
+			flag = true;
+			notify();
+		}
+
+		template<class Ready>
+		void wait(Ready ready)
+		{
+			ScopeLock<Mutex> lock(mutex);
+			waiting++;
+			std::atomic_thread_fence(std::memory_order_seq_cst); // the other thread sees the waiting, or this thread sees its changes
+			while (!ready())
+				cond->wait(mutex);
+			waiting--;
+		}
+
+		void notify()
+		{
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (waiting.load(std::memory_order_relaxed) == 0)
+				return;
+			ScopeLock<Mutex> lock(mutex); // the waiting thread is either blocked already or has not checked the condition yet
+			cond->broadcast();
+		}
+	};
+}
 
 struct InputImpl : public Input
 {
 	Holder<File> file;
+	Holder<LineQueue> queue;
+	Holder<Thread> thread;
 
-	InputImpl(const string &path)
+	InputImpl(const string &path, bool async)
 	{
 		if (!path.empty())
 		{
 			CAGE_LOG(SeverityEnum::Info, "qasmint", stringizer() + "redirecting input from: '" + path + "'");
 			file = readFile(path);
 		}
+		// standard input may stay open without providing more lines (eg. interactive judge)
+		// the thread blocked reading it could not be stopped when the program ends, therefore only files are prefetched
+		if (async && file)
+		{
+			CAGE_LOG(SeverityEnum::Info, "qasmint", "prefetching input on separate thread");
+			queue = detail::systemArena().createHolder<LineQueue>();
+			thread = newThread(Delegate<void()>().bind<InputImpl, &InputImpl::prefetch>(this), "qasmint input");
+		}
+	}
+
+	~InputImpl()
+	{
+		if (thread)
+		{
+			// reading the file does not block, the thread finishes after reading next line
+			queue->signal(queue->stopping);
+			thread->wait();
+		}
+	}
+
+	void prefetch()
+	{
+		try
+		{
+			string line;
+			while (!queue->stopping && readLineDirect(line))
+			{
+				if (!queue->push(line))
+					break;
+			}
+		}
+		catch (...)
+		{
+			detail::logCurrentCaughtException();
+			queue->failed = true;
+		}
+		queue->signal(queue->finished);
 	}
 
 	bool readLine(string &line)
+	{
+		if (!queue)
+			return readLineDirect(line);
+		if (queue->pop(line))
+			return true;
+		if (queue->failed)
+			CAGE_THROW_ERROR(Exception, "failed reading input");
+		return false;
+	}
+
+	bool readLineDirect(string &line)
 	{
 		if (file)
 		{
@@ -34,6 +191,24 @@ struct InputImpl : public Input
 			return true;
 		}
 	}
+
+	uint32 readBinary(PointerRange<uint32> values)
+	{
+		// values are stored in the host byte order, which is little-endian on all supported platforms
+		if (file)
+		{
+			const uint32 count = numeric_cast<uint32>(min(uintPtr(values.size()), (file->size() - file->tell()) / sizeof(uint32)));
+			file->read({ (char *)values.data(), (char *)(values.data() + count) });
+			return count;
+		}
+		else
+		{
+#ifdef CAGE_SYSTEM_WINDOWS
+			_setmode(_fileno(stdin), _O_BINARY);
+#endif
+			return numeric_cast<uint32>(std::fread(values.data(), sizeof(uint32), values.size(), stdin));
+		}
+	}
 };
 
 bool Input::readLine(string &line)
@@ -42,25 +217,88 @@ bool Input::readLine(string &line)
 	return impl->readLine(line);
 }
 
-Holder<Input> newInput(const string &path)
+uint32 Input::readBinary(PointerRange<uint32> values)
+{
+	InputImpl *impl = (InputImpl *)this;
+	return impl->readBinary(values);
+}
+
+Holder<Input> newInput(const string &path, bool async)
 {
-	return detail::systemArena().createImpl<Input, InputImpl>(path);
+	return detail::systemArena().createImpl<Input, InputImpl>(path, async);
 }
 
 struct OutputImpl : public Output
 {
 	Holder<File> file;
+	Holder<LineQueue> queue;
+	Holder<Thread> thread;
 
-	OutputImpl(const string &path)
+	OutputImpl(const string &path, bool async)
 	{
 		if (!path.empty())
 		{
 			CAGE_LOG(SeverityEnum::Info, "qasmint", stringizer() + "redirecting output into: '" + path + "'");
 			file = writeFile(path);
 		}
+		if (async)
+		{
+			CAGE_LOG(SeverityEnum::Info, "qasmint", "writing output on separate thread");
+			queue = detail::systemArena().createHolder<LineQueue>();
+			thread = newThread(Delegate<void()>().bind<OutputImpl, &OutputImpl::drain>(this), "qasmint output");
+		}
+	}
+
+	~OutputImpl()
+	{
+		finish();
+	}
+
+	void finish()
+	{
+		if (thread)
+		{
+			queue->signal(queue->finished);
+			thread->wait(); // all queued lines are written before the thread ends
+			thread.clear();
+		}
+	}
+
+	void drain()
+	{
+		try
+		{
+			string line;
+			while (true)
+			{
+				if (queue->tryPop(line))
+				{
+					queue->notify();
+					writeLineDirect(line, false);
+					continue;
+				}
+				if (!file)
+					std::cout.flush(); // flush only when there is nothing more to write
+				if (!queue->pop(line))
+					break;
+				writeLineDirect(line, false);
+			}
+		}
+		catch (...)
+		{
+			detail::logCurrentCaughtException();
+			queue->signal(queue->failed);
+		}
 	}
 
 	bool writeLine(const string &line)
+	{
+		if (!queue)
+			return writeLineDirect(line, true);
+		return queue->push(line) && !queue->failed;
+	}
+
+	bool writeLineDirect(const string &line, bool flush)
 	{
 		if (file)
 		{
@@ -69,9 +307,27 @@ struct OutputImpl : public Output
 		}
 		else
 		{
-			std::cout << line.data() << std::endl;
+			std::cout << line.data() << '\n';
+			if (flush)
+				std::cout.flush();
+			return true;
+		}
+	}
+
+	bool writeBinary(PointerRange<const uint32> values)
+	{
+		if (file)
+		{
+			file->write({ (const char *)values.begin(), (const char *)values.end() });
 			return true;
 		}
+		else
+		{
+#ifdef CAGE_SYSTEM_WINDOWS
+			_setmode(_fileno(stdout), _O_BINARY);
+#endif
+			return std::fwrite(values.data(), sizeof(uint32), values.size(), stdout) == values.size();
+		}
 	}
 };
 
@@ -81,14 +337,23 @@ bool Output::writeLine(const string &line)
 	return impl->writeLine(line);
 }
 
+bool Output::writeBinary(PointerRange<const uint32> values)
+{
+	OutputImpl *impl = (OutputImpl *)this;
+	return impl->writeBinary(values);
+}
+
 void Output::close()
 {
 	OutputImpl *impl = (OutputImpl *)this;
+	impl->finish();
 	if (impl->file)
 		impl->file->close();
+	else
+		std::fflush(stdout);
 }
 
-Holder<Output> newOutput(const string &path)
+Holder<Output> newOutput(const string &path, bool async)
 {
-	return detail::systemArena().createImpl<Output, OutputImpl>(path);
+	return detail::systemArena().createImpl<Output, OutputImpl>(path, async);
 }
@@ -8,16 +8,18 @@ using namespace cage;
 struct Input : private Immovable
 {
 	bool readLine(string &line);
+	uint32 readBinary(PointerRange<uint32> values); // returns number of values actually read
 };
 
-Holder<Input> newInput(const string &path);
+Holder<Input> newInput(const string &path, bool async = false); // async: lines are prefetched on a dedicated thread
 
 struct Output : private Immovable
 {
 	bool writeLine(const string &line);
+	bool writeBinary(PointerRange<const uint32> values);
 	void close();
 };
 
-Holder<Output> newOutput(const string &path);
+Holder<Output> newOutput(const string &path, bool async = false); // async: lines are written on a dedicated thread
 
 #endif // io_h_s54gse85
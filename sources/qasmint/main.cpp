@@ -7,6 +7,10 @@
 #include <qasm/qasm.h>
 
 #include "io.h"
+#include "mappedFile.h"
+#include "programCache.h"
+
+#include <vector>
 
 using namespace qasm;
 
@@ -22,7 +26,16 @@ int main(int argc, const char *args[])
 		ConfigString limitsPath("qasmint/path/limits");
 		ConfigString inputPath("qasmint/path/input");
 		ConfigString outputPath("qasmint/path/output");
+		ConfigString exportPath("qasmint/path/export");
+		ConfigString cachePath("qasmint/path/cache");
+		ConfigBool precompiled("qasmint/program/precompiled");
+		ConfigBool moduleOnly("qasmint/program/module");
+		ConfigUint32 optimize("qasmint/program/optimize");
 		ConfigBool suppressConsoleLog("qasmint/log/suppressConsole");
+		ConfigBool asyncIo("qasmint/io/async");
+		ConfigBool binaryInput("qasmint/io/binaryInput");
+		ConfigBool binaryOutput("qasmint/io/binaryOutput");
+		std::vector<string> modulePaths;
 
 		{
 			Holder<Ini> ini = newIni();
@@ -31,36 +44,113 @@ int main(int argc, const char *args[])
 			limitsPath = ini->cmdString('l', "limits", limitsPath);
 			inputPath = ini->cmdString('i', "input", inputPath);
 			outputPath = ini->cmdString('o', "output", outputPath);
+			exportPath = ini->cmdString('e', "export", exportPath);
+			cachePath = ini->cmdString('C', "cache", cachePath);
+			precompiled = ini->cmdBool('c', "compiled", precompiled);
+			moduleOnly = ini->cmdBool('M', "compileModule", moduleOnly);
+			for (const string &path : ini->cmdArray('m', "module"))
+				modulePaths.push_back(path);
+			optimize = ini->cmdUint32('x', "optimize", optimize);
 			suppressConsoleLog = ini->cmdBool('f', "filter", suppressConsoleLog);
+			asyncIo = ini->cmdBool('a', "async", asyncIo);
+			binaryInput = ini->cmdBool('I', "binaryInput", binaryInput);
+			binaryOutput = ini->cmdBool('O', "binaryOutput", binaryOutput);
 			ini->checkUnusedWithHelp();
 		}
 
 		if (suppressConsoleLog)
 			logger.clear();
 
+		CpuLimitsConfig limits;
+		if (!string(limitsPath).empty())
+		{
+			CAGE_LOG(SeverityEnum::Info, "qasmint", stringizer() + "loading limits at path: '" + string(limitsPath) + "'");
+			Holder<Ini> ini = newIni();
+			ini->importFile(limitsPath);
+			limits = qasm::limitsFromIni(+ini);
+		}
+
+		CompilerCreateConfig compilerConfig;
+		compilerConfig.constantPropagation = optimize >= 1;
+		compilerConfig.deadCodeElimination = optimize >= 1;
+		compilerConfig.jumpThreading = optimize >= 1;
+		compilerConfig.inlining = optimize >= 2;
+		compilerConfig.disabledInstructions = limits.disabledInstructions;
+
+		if (moduleOnly)
+		{
+			if (string(exportPath).empty())
+				CAGE_THROW_ERROR(Exception, "compiling module requires export path");
+			CAGE_LOG(SeverityEnum::Info, "qasmint", stringizer() + "compiling module at path: '" + string(programPath) + "'");
+			Holder<File> file = readFile(programPath);
+			Holder<Module> module = newCompiler(compilerConfig)->compileModule(file->readAll());
+			CAGE_LOG(SeverityEnum::Info, "qasmint", stringizer() + "exporting module to path: '" + string(exportPath) + "'");
+			Holder<File> out = writeFile(exportPath);
+			out->write(module->exportBuffer());
+			out->close();
+			return 0;
+		}
+
+		std::vector<Holder<Module>> modules;
+		std::vector<const Module *> modulePointers;
+		for (const string &path : modulePaths)
+		{
+			CAGE_LOG(SeverityEnum::Info, "qasmint", stringizer() + "loading module at path: '" + path + "'");
+			Holder<File> file = readFile(path);
+			modules.push_back(newModule(file->readAll()));
+			modulePointers.push_back(+modules.back());
+		}
+
+		Holder<MappedFile> programFile;
+		Holder<ProgramCache> programCache;
 		Holder<Program> program;
 		{
 			CAGE_LOG(SeverityEnum::Info, "qasmint", stringizer() + "loading program at path: '" + string(programPath) + "'");
-			Holder<File> file = readFile(programPath);
-			Holder<Compiler> compiler = newCompiler();
-			program = compiler->compile(file->readAll());
+			if (precompiled)
+			{
+				if (!modules.empty())
+					CAGE_THROW_ERROR(Exception, "modules cannot be linked with precompiled program");
+				programFile = newMappedFile(programPath);
+				program = newProgram(programFile->data());
+			}
+			else if (!string(cachePath).empty() && modules.empty())
+			{
+				Holder<File> file = readFile(programPath);
+				programCache = newProgramCache(cachePath, compilerConfig);
+				program = programCache->load(file->readAll());
+			}
+			else
+			{
+				Holder<File> file = readFile(programPath);
+				Holder<Compiler> compiler = newCompiler(compilerConfig);
+				program = compiler->compile(file->readAll(), modulePointers);
+			}
 			CAGE_LOG(SeverityEnum::Info, "qasmint", stringizer() + "program has: " + program->instructionsCount() + " instructions");
 		}
 
-		Holder<Input> input = newInput(inputPath);
-		Holder<Output> output = newOutput(outputPath);
+		if (!string(exportPath).empty())
+		{
+			CAGE_LOG(SeverityEnum::Info, "qasmint", stringizer() + "exporting program to path: '" + string(exportPath) + "'");
+			Holder<File> file = writeFile(exportPath);
+			file->write(program->exportBuffer());
+			file->close();
+			return 0;
+		}
+
+		Holder<Input> input = newInput(inputPath, asyncIo && !binaryInput);
+		Holder<Output> output = newOutput(outputPath, asyncIo && !binaryOutput);
 		Holder<Cpu> cpu;
 		{
 			CpuCreateConfig cfg;
-			if (!string(limitsPath).empty())
-			{
-				CAGE_LOG(SeverityEnum::Info, "qasmint", stringizer() + "loading limits at path: '" + string(limitsPath) + "'");
-				Holder<Ini> limits = newIni();
-				limits->importFile(limitsPath);
-				cfg.limits = qasm::limitsFromIni(+limits);
-			}
-			cfg.input.bind<Input, &Input::readLine>(+input);
-			cfg.output.bind<Output, &Output::writeLine>(+output);
+			cfg.limits = limits;
+			if (binaryInput)
+				cfg.binaryInput.bind<Input, &Input::readBinary>(+input);
+			else
+				cfg.input.bind<Input, &Input::readLine>(+input);
+			if (binaryOutput)
+				cfg.binaryOutput.bind<Output, &Output::writeBinary>(+output);
+			else
+				cfg.output.bind<Output, &Output::writeLine>(+output);
 			cpu = newCpu(cfg);
 			cpu->program(+program);
 		}
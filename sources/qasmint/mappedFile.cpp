@@ -0,0 +1,96 @@
+#include "mappedFile.h"
+
+#ifdef CAGE_SYSTEM_WINDOWS
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+struct MappedFileImpl : public MappedFile
+{
+	const char *address = nullptr;
+	uintPtr size = 0;
+
+#ifdef CAGE_SYSTEM_WINDOWS
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+
+	MappedFileImpl(const string &path)
+	{
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			CAGE_THROW_ERROR(SystemError, "CreateFile", GetLastError());
+		LARGE_INTEGER s;
+		if (!GetFileSizeEx(file, &s))
+			CAGE_THROW_ERROR(SystemError, "GetFileSizeEx", GetLastError());
+		size = numeric_cast<uintPtr>(s.QuadPart);
+		if (size == 0)
+			return;
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!mapping)
+			CAGE_THROW_ERROR(SystemError, "CreateFileMapping", GetLastError());
+		address = (const char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (!address)
+			CAGE_THROW_ERROR(SystemError, "MapViewOfFile", GetLastError());
+	}
+
+	~MappedFileImpl()
+	{
+		if (address)
+			UnmapViewOfFile(address);
+		if (mapping)
+			CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+	}
+#else
+	MappedFileImpl(const string &path)
+	{
+		const int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			CAGE_THROW_ERROR(SystemError, "open", errno);
+		struct stat st;
+		if (fstat(fd, &st) != 0)
+		{
+			const int err = errno;
+			close(fd);
+			CAGE_THROW_ERROR(SystemError, "fstat", err);
+		}
+		size = numeric_cast<uintPtr>(st.st_size);
+		if (size > 0)
+		{
+			void *a = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (a == MAP_FAILED)
+			{
+				const int err = errno;
+				close(fd);
+				CAGE_THROW_ERROR(SystemError, "mmap", err);
+			}
+			address = (const char *)a;
+		}
+		close(fd); // the mapping stays valid
+	}
+
+	~MappedFileImpl()
+	{
+		if (address)
+			munmap((void *)address, size);
+	}
+#endif // CAGE_SYSTEM_WINDOWS
+};
+
+PointerRange<const char> MappedFile::data() const
+{
+	const MappedFileImpl *impl = (const MappedFileImpl *)this;
+	return { impl->address, impl->address + (impl->address ? impl->size : 0) };
+}
+
+Holder<MappedFile> newMappedFile(const string &path)
+{
+	return detail::systemArena().createImpl<MappedFile, MappedFileImpl>(path);
+}
@@ -0,0 +1,16 @@
+#ifndef mappedFile_h_4hg8e5rt1
+#define mappedFile_h_4hg8e5rt1
+
+#include <cage-core/core.h>
+
+using namespace cage;
+
+// read-only view of whole file content mapped into memory
+struct MappedFile : private Immovable
+{
+	PointerRange<const char> data() const;
+};
+
+Holder<MappedFile> newMappedFile(const string &path);
+
+#endif // mappedFile_h_4hg8e5rt1
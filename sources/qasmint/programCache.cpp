@@ -0,0 +1,147 @@
+#include <cage-core/files.h>
+#include <cage-core/logger.h>
+
+#include "programCache.h"
+#include "mappedFile.h"
+
+#include <vector>
+#include <random>
+
+namespace
+{
+	uint64 hashSource(PointerRange<const char> sourceCode)
+	{
+		// fnv-1a
+		uint64 h = 14695981039346656037ull;
+		for (const char c : sourceCode)
+		{
+			h ^= uint8(c);
+			h *= 1099511628211ull;
+		}
+		return h;
+	}
+
+	string toHex(uint64 v)
+	{
+		constexpr const char digits[] = "0123456789abcdef";
+		char s[16];
+		for (uint32 i = 0; i < 16; i++)
+			s[i] = digits[(v >> (60 - i * 4)) & 15];
+		return string(PointerRange<const char>(s, s + 16));
+	}
+
+	bool sameSource(const Program *program, PointerRange<const char> sourceCode)
+	{
+		const PointerRange<const char> s = program->sourceCode();
+		return s.size() == sourceCode.size() && detail::memcmp(s.data(), sourceCode.data(), s.size()) == 0;
+	}
+}
+
+struct ProgramCacheImpl : public ProgramCache
+{
+	const string directory;
+	const CompilerCreateConfig config;
+	std::vector<Holder<MappedFile>> files; // must outlive the loaded programs
+
+	ProgramCacheImpl(const string &directory, const CompilerCreateConfig &config) : directory(directory), config(config)
+	{}
+
+	string fileName(PointerRange<const char> sourceCode) const
+	{
+		// programs compiled with different optimizations or disabled instructions are stored separately
+		string options;
+		if (config.constantPropagation)
+			options += "c";
+		if (config.deadCodeElimination)
+			options += "d";
+		if (config.jumpThreading)
+			options += "j";
+		if (config.inlining)
+			options += "i";
+		if (!config.disabledInstructions.empty())
+		{
+			// order of the names does not matter
+			uint64 h = 0;
+			for (const string &n : config.disabledInstructions)
+				h += hashSource(n);
+			options += string("x") + toHex(h);
+		}
+		if (!options.empty())
+			options = string(".") + options;
+		return stringizer() + toHex(hashSource(sourceCode)) + ".v" + ProgramFormatVersion + ".c" + CompilerVersion + options + ".qasmc";
+	}
+
+	Holder<Program> tryLoad(const string &path, PointerRange<const char> sourceCode)
+	{
+		if (!pathIsFile(path))
+			return {};
+		try
+		{
+			Holder<MappedFile> file = newMappedFile(path);
+			Holder<Program> program = newProgram(file->data());
+			if (!sameSource(+program, sourceCode))
+				return {}; // hash collision
+			files.push_back(templates::move(file));
+			return program;
+		}
+		catch (const Exception &)
+		{
+			// damaged or incompatible file, it will be replaced
+			return {};
+		}
+	}
+
+	void store(const string &path, const Program *program)
+	{
+		// write to unique temporary file and atomically rename it, readers never observe partial file
+		const string tmpPath = path + "." + toHex((uint64(std::random_device()()) << 32) | std::random_device()()) + ".tmp";
+		try
+		{
+			pathCreateDirectories(directory);
+			{
+				Holder<File> file = writeFile(tmpPath);
+				file->write(program->exportBuffer());
+				file->close();
+			}
+			pathMove(tmpPath, path);
+		}
+		catch (const Exception &)
+		{
+			// the cache is optional, another process may have stored the same program
+			CAGE_LOG(SeverityEnum::Warning, "qasmint", "failed to store program in cache");
+			try
+			{
+				if (pathIsFile(tmpPath))
+					pathRemove(tmpPath);
+			}
+			catch (const Exception &)
+			{
+				// nothing
+			}
+		}
+	}
+
+	Holder<Program> load(PointerRange<const char> sourceCode)
+	{
+		const string path = pathJoin(directory, fileName(sourceCode));
+		if (Holder<Program> program = tryLoad(path, sourceCode))
+		{
+			CAGE_LOG(SeverityEnum::Info, "qasmint", stringizer() + "loaded program from cache: '" + path + "'");
+			return program;
+		}
+		Holder<Program> program = newCompiler(config)->compile(sourceCode);
+		store(path, +program);
+		return program;
+	}
+};
+
+Holder<Program> ProgramCache::load(PointerRange<const char> sourceCode)
+{
+	ProgramCacheImpl *impl = (ProgramCacheImpl *)this;
+	return impl->load(sourceCode);
+}
+
+Holder<ProgramCache> newProgramCache(const string &directory, const CompilerCreateConfig &config)
+{
+	return detail::systemArena().createImpl<ProgramCache, ProgramCacheImpl>(directory, config);
+}
@@ -0,0 +1,16 @@
+#ifndef programCache_h_9d6s4f1ju
+#define programCache_h_9d6s4f1ju
+
+#include <qasm/qasm.h>
+
+using namespace qasm;
+
+// content-addressed directory of compiled programs, shared by concurrently running processes
+struct ProgramCache : private Immovable
+{
+	Holder<Program> load(PointerRange<const char> sourceCode); // compiles and stores the program on miss, the program must not outlive the cache
+};
+
+Holder<ProgramCache> newProgramCache(const string &directory, const CompilerCreateConfig &config = {});
+
+#endif // programCache_h_9d6s4f1ju
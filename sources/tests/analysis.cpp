@@ -0,0 +1,165 @@
+#include "main.h"
+
+namespace
+{
+	constexpr uint64 bit(char name)
+	{
+		return uint64(1) << (name >= 'a' ? name - 'a' + 26 : name - 'A');
+	}
+}
+
+void testAnalysis()
+{
+	CAGE_TESTCASE("analysis");
+
+	{
+		CAGE_TESTCASE("loop with call");
+		constexpr const char source[] = R"asm(
+set A 0
+set B 10
+label Loop
+call Increment
+lt z A B
+condjmp Loop
+write A
+
+function Increment
+inc A
+return
+)asm";
+		Holder<Program> program = newCompiler()->compile(source);
+		CAGE_TEST(program->instructionsCount() == 10);
+		const ProgramAnalysis &a = program->analysis();
+		CAGE_TEST(&a == &program->analysis());
+		const auto blocks = a.blocks();
+
+		{
+			CAGE_TESTCASE("blocks");
+			CAGE_TEST(blocks.size() == 6);
+			CAGE_TEST(blocks[1].firstInstruction == 2 && blocks[1].instructionsCount == 1);
+			CAGE_TEST(blocks[2].firstInstruction == 3 && blocks[2].instructionsCount == 2);
+			CAGE_TEST(blocks[3].firstInstruction == 5 && blocks[3].instructionsCount == 2);
+			CAGE_TEST(a.blockIndex(0) == 0);
+			CAGE_TEST(a.blockIndex(4) == 2);
+			CAGE_TEST(a.blockIndex(8) == 4);
+			CAGE_TEST_THROWN(a.blockIndex(10));
+		}
+
+		{
+			CAGE_TESTCASE("edges");
+			CAGE_TEST(a.successors(0).size() == 1 && a.successors(0)[0] == 1);
+			CAGE_TEST(a.successors(1).size() == 1 && a.successors(1)[0] == 2);
+			CAGE_TEST(a.successors(2).size() == 2 && a.successors(2)[0] == 1 && a.successors(2)[1] == 3);
+			CAGE_TEST(a.successors(3).empty());
+			CAGE_TEST(a.successors(4).empty());
+			CAGE_TEST(a.predecessors(1).size() == 2);
+			CAGE_TEST(a.predecessors(4).empty());
+		}
+
+		{
+			CAGE_TESTCASE("functions and calls");
+			CAGE_TEST(a.functions().size() == 2);
+			CAGE_TEST(a.functions()[0].entryBlock == 0);
+			CAGE_TEST(a.functions()[1].entryBlock == 4);
+			CAGE_TEST(program->functionName(a.functions()[1].functionIndex) == "Increment");
+			CAGE_TEST(a.calls().size() == 1);
+			CAGE_TEST(a.calls()[0].block == 1);
+			CAGE_TEST(a.calls()[0].caller == 0);
+			CAGE_TEST(a.calls()[0].callee == 1);
+			CAGE_TEST(blocks[3].function == 0);
+			CAGE_TEST(blocks[4].function == 1);
+			CAGE_TEST(blocks[5].function == m); // unreachable end of the function
+			CAGE_TEST(a.callDepth() == 1);
+		}
+
+		{
+			CAGE_TESTCASE("dominators and loops");
+			CAGE_TEST(blocks[0].immediateDominator == m);
+			CAGE_TEST(blocks[1].immediateDominator == 0);
+			CAGE_TEST(blocks[2].immediateDominator == 1);
+			CAGE_TEST(blocks[3].immediateDominator == 2);
+			CAGE_TEST(blocks[4].immediateDominator == m);
+			CAGE_TEST(a.dominates(1, 3));
+			CAGE_TEST(!a.dominates(3, 1));
+			CAGE_TEST(!a.dominates(0, 4));
+			CAGE_TEST(blocks[0].loopHeader == m && blocks[0].loopDepth == 0);
+			CAGE_TEST(blocks[1].loopHeader == 1 && blocks[1].loopDepth == 1);
+			CAGE_TEST(blocks[2].loopHeader == 1 && blocks[2].loopDepth == 1);
+			CAGE_TEST(blocks[3].loopHeader == m && blocks[3].loopDepth == 0);
+		}
+
+		{
+			CAGE_TESTCASE("liveness");
+			CAGE_TEST(blocks[0].liveIn == 0);
+			CAGE_TEST(blocks[0].liveOut == (bit('A') | bit('B')));
+			CAGE_TEST(blocks[1].liveIn == (bit('A') | bit('B')));
+			CAGE_TEST(blocks[4].liveIn == (bit('A') | bit('B'))); // B is used after return
+			CAGE_TEST(blocks[2].liveOut == (bit('A') | bit('B')));
+			CAGE_TEST(blocks[3].liveIn == bit('A'));
+			CAGE_TEST(blocks[3].liveOut == 0);
+		}
+	}
+
+	{
+		CAGE_TESTCASE("nested loops");
+		constexpr const char source[] = R"asm(
+set A 0
+label Outer
+set B 0
+label Inner
+inc B
+lt z B A
+condjmp Inner
+inc A
+lt z A C
+condjmp Outer
+)asm";
+		Holder<Program> program = newCompiler()->compile(source);
+		const ProgramAnalysis &a = program->analysis();
+		const auto blocks = a.blocks();
+		CAGE_TEST(blocks.size() == 5);
+		CAGE_TEST(blocks[1].loopHeader == 1 && blocks[1].loopDepth == 1); // set B
+		CAGE_TEST(blocks[2].loopHeader == 2 && blocks[2].loopDepth == 2); // inner loop
+		CAGE_TEST(blocks[3].loopHeader == 1 && blocks[3].loopDepth == 1); // inc A
+		CAGE_TEST(blocks[4].loopHeader == m && blocks[4].loopDepth == 0); // exit
+		CAGE_TEST(blocks[2].liveIn == (bit('A') | bit('B') | bit('C')));
+		CAGE_TEST((blocks[1].liveIn & bit('B')) == 0);
+		CAGE_TEST(a.callDepth() == 0);
+	}
+
+	{
+		CAGE_TESTCASE("call depth");
+		constexpr const char chain[] = R"asm(
+call First
+condcall Second
+function First
+call Second
+return
+function Second
+condcall Third
+return
+function Third
+return
+)asm";
+		CAGE_TEST(newCompiler()->compile(chain)->analysis().callDepth() == 3);
+		constexpr const char recursion[] = R"asm(
+call First
+function First
+condcall Second
+return
+function Second
+call First
+return
+)asm";
+		CAGE_TEST(newCompiler()->compile(recursion)->analysis().callDepth() == m);
+		constexpr const char unreachableRecursion[] = R"asm(
+call First
+function First
+return
+function Second
+call Second
+return
+)asm";
+		CAGE_TEST(newCompiler()->compile(unreachableRecursion)->analysis().callDepth() == 1);
+	}
+}
@@ -2,6 +2,18 @@
 
 #include "main.h"
 
+#include <string>
+
+namespace
+{
+	bool sameExport(const Holder<Program> &a, const Holder<Program> &b)
+	{
+		Holder<PointerRange<char>> x = a->exportBuffer();
+		Holder<PointerRange<char>> y = b->exportBuffer();
+		return x.size() == y.size() && detail::memcmp(x.data(), y.data(), x.size()) == 0;
+	}
+}
+
 void testCompilation()
 {
 	CAGE_TESTCASE("compilation");
@@ -44,12 +56,54 @@ set C 7
 		CAGE_TEST_THROWN(newCompiler()->compile(source));
 	}
 
+	{
+		CAGE_TESTCASE("invalid character in long line");
+		constexpr const char source[] = R"asm(
+set A 5 # this comment is long enough to span multiple blocks of characters; and $ is not allowed
+)asm";
+		CAGE_TEST_THROWN(newCompiler()->compile(source));
+	}
+
+	{
+		CAGE_TESTCASE("comment characters in code");
+		constexpr const char source[] = R"asm(
+set A 5 ; set B 6
+)asm";
+		CAGE_TEST_THROWN(newCompiler()->compile(source));
+	}
+
+	{
+		CAGE_TESTCASE("valid characters");
+		constexpr const char source[] = R"asm(
+set A 5 # comments may contain: * / , ( ) < > = ? ! : ; and all of - + . _ @ #
+fset B -1.5e+3
+)asm";
+		newCompiler()->compile(source);
+	}
+
 	{
 		CAGE_TESTCASE("unknown instruction");
 		constexpr const char source[] = R"asm(
 asdfg
 )asm";
 		CAGE_TEST_THROWN(newCompiler()->compile(source));
+		CAGE_TEST_THROWN(newCompiler()->compile("ad A B C"));
+		CAGE_TEST_THROWN(newCompiler()->compile("addd A B C"));
+		CAGE_TEST_THROWN(newCompiler()->compile("Add A B C"));
+		CAGE_TEST_THROWN(newCompiler()->compile("condjump Label"));
+	}
+
+	{
+		CAGE_TESTCASE("multiple spaces between arguments");
+		constexpr const char source[] = R"asm(
+  set   A    13  # comment
+add B  A   A
+)asm";
+		Holder<Program> program = newCompiler()->compile(source);
+		Holder<Cpu> cpu = newCpu({});
+		cpu->program(+program);
+		cpu->run();
+		CAGE_TEST(cpu->registers()[1] == 26);
 	}
 
 	{
@@ -308,4 +362,370 @@ set A 256
 			CAGE_TEST(cpu->registers()[0] == 256);
 		}
 	}
+
+	{
+		CAGE_TESTCASE("incremental compilation");
+		constexpr const char original[] = R"asm(
+call First
+call Second
+function First
+set A 1
+jump Skip
+set A 2
+label Skip
+return
+function Second
+copy B A
+inc B
+return
+)asm";
+		constexpr const char edited[] = R"asm(
+call First
+call Second
+function First
+set A 1
+jump Skip
+set A 3
+label Skip
+return
+function Second
+copy B A
+inc B
+return
+)asm";
+		constexpr const char shifted[] = R"asm(
+set C 5
+call First
+call Second
+function First
+set A 1
+jump Skip
+set A 3
+label Skip
+return
+function Second
+copy B A
+inc B
+return
+)asm";
+		constexpr const char added[] = R"asm(
+set C 5
+call Third
+call First
+call Second
+function Third
+set D 7
+return
+function First
+set A 1
+jump Skip
+set A 3
+label Skip
+return
+function Second
+copy B A
+inc B
+return
+)asm";
+		constexpr const char removed[] = R"asm(
+set C 5
+call Third
+call Second
+function Third
+set D 7
+return
+function Second
+copy B A
+inc B
+return
+)asm";
+		CompilerCreateConfig config;
+		config.constantPropagation = config.deadCodeElimination = config.jumpThreading = config.inlining = true;
+		for (const CompilerCreateConfig &cfg : { CompilerCreateConfig(), config })
+		{
+			Holder<Compiler> compiler = newCompiler(cfg);
+			const PointerRange<const char> sources[] = { original, edited, shifted, added, removed, original };
+			for (const PointerRange<const char> source : sources)
+			{
+				Holder<Program> program = compiler->compile(source);
+				CAGE_TEST(sameExport(program, newCompiler(cfg)->compile(source)));
+			}
+		}
+		{
+			CAGE_TESTCASE("errors in unchanged functions");
+			Holder<Compiler> compiler = newCompiler();
+			compiler->compile(original);
+			constexpr const char duplicate[] = R"asm(
+call First
+call Second
+function First
+set A 1
+jump Skip
+set A 2
+label Skip
+return
+function Second
+copy B A
+inc B
+return
+function First
+return
+)asm";
+			CAGE_TEST_THROWN(compiler->compile(duplicate));
+			constexpr const char duplicateBefore[] = R"asm(
+call First
+call Second
+function Second
+return
+function First
+set A 1
+jump Skip
+set A 2
+label Skip
+return
+function Second
+copy B A
+inc B
+return
+)asm";
+			CAGE_TEST_THROWN(compiler->compile(duplicateBefore));
+			constexpr const char missing[] = R"asm(
+call First
+call Second
+function Second
+copy B A
+inc B
+return
+)asm";
+			CAGE_TEST_THROWN(compiler->compile(missing));
+			Holder<Program> program = compiler->compile(original);
+			CAGE_TEST(sameExport(program, newCompiler()->compile(original)));
+			Holder<Cpu> cpu = newCpu({});
+			cpu->program(+program);
+			cpu->run();
+			CAGE_TEST(cpu->registers()[0] == 1);
+			CAGE_TEST(cpu->registers()[1] == 2);
+		}
+	}
+
+	{
+		CAGE_TESTCASE("parallel compilation");
+		const auto &name = [](uint32 i) {
+			return std::string("F") + char('A' + i / 26) + char('A' + i % 26);
+		};
+		std::string source = "call " + name(0) + "\n";
+		for (uint32 i = 0; i < 200; i++)
+		{
+			source += "function " + name(i) + "\n";
+			source += "inc A\nlabel Loop\ninc B\ncopy z C\ncondjmp Loop\n";
+			if (i + 1 < 200)
+				source += "call " + name(i + 1) + "\n";
+			source += "return\n";
+		}
+		const PointerRange<const char> range = { source.data(), source.data() + source.size() };
+		CompilerCreateConfig config;
+		config.threads = 4;
+		Holder<Program> sequential = newCompiler()->compile(range);
+		Holder<Program> parallel = newCompiler(config)->compile(range);
+		CAGE_TEST(sameExport(sequential, parallel));
+		Holder<Cpu> cpu = newCpu({});
+		cpu->program(+parallel);
+		cpu->run();
+		CAGE_TEST(cpu->registers()[0] == 200);
+		CAGE_TEST(cpu->registers()[1] == 200);
+		{
+			CAGE_TESTCASE("all optimizations");
+			config.constantPropagation = config.deadCodeElimination = config.jumpThreading = config.inlining = true;
+			Holder<Program> parallel = newCompiler(config)->compile(range);
+			config.threads = 1;
+			CAGE_TEST(sameExport(parallel, newCompiler(config)->compile(range)));
+		}
+		{
+			CAGE_TESTCASE("errors");
+			config = {};
+			config.threads = 4;
+			Holder<Compiler> compiler = newCompiler(config);
+			const std::string duplicate = source + "function " + name(10) + "\nreturn\n";
+			CAGE_TEST_THROWN(compiler->compile({ duplicate.data(), duplicate.data() + duplicate.size() }));
+			const std::string invalid = source + "function Extra\nset\nreturn\n";
+			CAGE_TEST_THROWN(compiler->compile({ invalid.data(), invalid.data() + invalid.size() }));
+			const std::string missing = source + "function Extra\ncall Missing\nreturn\n";
+			CAGE_TEST_THROWN(compiler->compile({ missing.data(), missing.data() + missing.size() }));
+			CAGE_TEST(sameExport(compiler->compile(range), sequential));
+		}
+	}
+
+	{
+		CAGE_TESTCASE("modules");
+		constexpr const char library[] = R"asm(
+# doubles A
+function Double
+add A A A
+return
+
+# triples A
+function Triple
+copy B A
+call Double
+add A A B
+return
+data MA@1 7
+)asm";
+		constexpr const char helpers[] = R"asm(
+data MA@0 5 6
+function Sextuple
+call Double
+call Triple
+return
+)asm";
+		constexpr const char source[] = R"asm(
+set A 7
+call Sextuple
+)asm";
+		constexpr const char concatenated[] = R"asm(
+set A 7
+call Sextuple
+
+# doubles A
+function Double
+add A A A
+return
+
+# triples A
+function Triple
+copy B A
+call Double
+add A A B
+return
+data MA@1 7
+
+data MA@0 5 6
+function Sextuple
+call Double
+call Triple
+return
+)asm";
+		Holder<Module> lib = newCompiler()->compileModule(library);
+		Holder<Module> hlp = newCompiler()->compileModule(helpers);
+		const Module *modules[] = { +lib, +hlp };
+		Holder<Program> program = newCompiler()->compile(source, modules);
+		CAGE_TEST(sameExport(program, newCompiler()->compile(concatenated)));
+		CAGE_TEST(program->functionName(2) == "Triple");
+		CAGE_TEST(program->sourceCodeLine(11) == "copy B A");
+		CAGE_TEST(program->sourceCodeLine(20) == "call Triple");
+		Holder<Cpu> cpu = newCpu({});
+		cpu->program(+program);
+		cpu->run();
+		CAGE_TEST(cpu->registers()[0] == 7 * 6);
+		CAGE_TEST(cpu->memory(0)[0] == 5);
+		CAGE_TEST(cpu->memory(0)[1] == 6); // memory data are in order of the linked source code
+		{
+			CAGE_TESTCASE("all optimizations");
+			CompilerCreateConfig config;
+			config.constantPropagation = config.deadCodeElimination = config.jumpThreading = config.inlining = true;
+			CAGE_TEST(sameExport(newCompiler(config)->compile(source, modules), newCompiler(config)->compile(concatenated)));
+		}
+		{
+			CAGE_TESTCASE("export and load module");
+			Holder<PointerRange<char>> buffer = lib->exportBuffer();
+			Holder<Module> loaded = newModule(buffer);
+			Holder<Module> loadedHelpers = newModule(hlp->exportBuffer());
+			const Module *modules[] = { +loaded, +loadedHelpers };
+			CAGE_TEST(sameExport(newCompiler()->compile(source, modules), program));
+			CAGE_TEST_THROWN(newModule(PointerRange<const char>(buffer.data(), buffer.data() + buffer.size() - 1)));
+			buffer[0] = 'x';
+			CAGE_TEST_THROWN(newModule(buffer));
+		}
+		{
+			CAGE_TESTCASE("errors");
+			CAGE_TEST_THROWN(newCompiler()->compileModule(source));
+			constexpr const char missingLabel[] = R"asm(
+function Jumping
+jump Nowhere
+return
+)asm";
+			CAGE_TEST_THROWN(newCompiler()->compileModule(missingLabel));
+			Holder<Compiler> compiler = newCompiler();
+			const Module *onlyHelpers[] = { +hlp };
+			CAGE_TEST_THROWN(compiler->compile(source, onlyHelpers));
+			const Module *twice[] = { +lib, +hlp, +lib };
+			CAGE_TEST_THROWN(compiler->compile(source, twice));
+			constexpr const char duplicate[] = R"asm(
+set A 7
+call Sextuple
+function Double
+return
+)asm";
+			CAGE_TEST_THROWN(compiler->compile(duplicate, modules));
+			CAGE_TEST(sameExport(compiler->compile(source, modules), program));
+		}
+	}
+
+	{
+		CAGE_TESTCASE("source code lines");
+		constexpr const char source[] = "set A 1\r\n\r\n  set B 2 # comment\ninc A\n";
+		Holder<Program> program = newCompiler()->compile(source);
+		CAGE_TEST(program->sourceCodeLine(0) == "set A 1");
+		CAGE_TEST(program->sourceCodeLine(1) == "");
+		CAGE_TEST(program->sourceCodeLine(2) == "  set B 2 # comment");
+		CAGE_TEST(program->sourceCodeLine(3) == "inc A");
+		CAGE_TEST(program->sourceCodeLine(100) == "");
+		{
+			CAGE_TESTCASE("without source code");
+			CompilerCreateConfig config;
+			config.keepSourceCode = false;
+			Holder<Program> program = newCompiler(config)->compile(source);
+			CAGE_TEST(program->sourceCode().empty());
+			CAGE_TEST(program->sourceCodeLine(0) == "");
+			Holder<Cpu> cpu = newCpu({});
+			cpu->program(+program);
+			cpu->run();
+			CAGE_TEST(cpu->registers()[0] == 2);
+		}
+	}
+
+	{
+		CAGE_TESTCASE("export and load program");
+		constexpr const char source[] = R"asm(
+call SetValue
+function SetValue
+set A 42
+return
+)asm";
+		Holder<Program> compiled = newCompiler()->compile(source);
+		Holder<PointerRange<char>> buffer = compiled->exportBuffer();
+		Holder<Program> program = newProgram(buffer);
+		CAGE_TEST(program->instructionsCount() == compiled->instructionsCount());
+		CAGE_TEST(program->functionName(1) == "SetValue");
+		CAGE_TEST(program->sourceCode().size() == compiled->sourceCode().size());
+		CAGE_TEST(program->sourceCodeLine(2) == "function SetValue");
+		CAGE_TEST(program->sourceCodeLine(5).empty());
+		Holder<Cpu> cpu = newCpu({});
+		cpu->program(+program);
+		cpu->run();
+		CAGE_TEST(cpu->registers()[0] == 42);
+		{
+			CAGE_TESTCASE("without source code");
+			Holder<PointerRange<char>> buffer = compiled->exportBuffer(false);
+			Holder<Program> program = newProgram(buffer);
+			CAGE_TEST(program->sourceCode().empty());
+			CAGE_TEST(program->sourceCodeLine(2).empty());
+			CAGE_TEST(program->instructionsCount() == compiled->instructionsCount());
+		}
+		{
+			CAGE_TESTCASE("invalid buffers");
+			CAGE_TEST_THROWN(newProgram(PointerRange<const char>(buffer.data(), buffer.data() + 16)));
+			buffer[0] = 'x';
+			CAGE_TEST_THROWN(newProgram(buffer));
+		}
+		{
+			CAGE_TESTCASE("invalid instructions are rejected when loaded into cpu");
+			Holder<PointerRange<char>> buffer = compiled->exportBuffer(false);
+			const uint64 instructionsOffset = *(const uint64 *)(buffer.data() + 16); // offset of the first section
+			uint16 *instructions = (uint16 *)(buffer.data() + instructionsOffset);
+			instructions[program->instructionsCount() - 1] = 0; // replace the last instruction with nop
+			Holder<Program> program = newProgram(buffer);
+			CAGE_TEST_THROWN(cpu->program(+program));
+		}
+	}
 }
@@ -26,6 +26,44 @@ jump Start
 		CAGE_TEST(cpu->registers()[0] == 100);
 	}
 
+	{
+		CAGE_TESTCASE("stepping through fill loop");
+		constexpr const char source[] = R"asm(
+set C 5
+set F 3
+set I 0
+label Fill
+copy i I
+indstore MA F
+inc I
+lt z I C
+condjmp Fill
+)asm";
+		Holder<Program> program = newCompiler()->compile(source);
+		Holder<Cpu> cpu = newCpu({});
+		cpu->program(+program);
+		for (uint32 i = 0; i < 5; i++)
+			cpu->step();
+		CAGE_TEST(cpu->stepIndex() == 5);
+		CAGE_TEST(cpu->memory(0)[0] == 3);
+		CAGE_TEST(cpu->memory(0)[1] == 0);
+		CAGE_TEST(cpu->registers()['I' - 'A'] == 0);
+		uint32 steps = 5;
+		while (cpu->state() == CpuStateEnum::Running)
+		{
+			cpu->step();
+			steps++;
+		}
+		CAGE_TEST(cpu->state() == CpuStateEnum::Finished);
+		CAGE_TEST(steps == cpu->stepIndex());
+		CAGE_TEST(cpu->memory(0)[4] == 3);
+		CAGE_TEST(cpu->registers()['I' - 'A'] == 5);
+		cpu->reinitialize();
+		cpu->run();
+		CAGE_TEST(cpu->state() == CpuStateEnum::Finished);
+		CAGE_TEST(cpu->stepIndex() == steps);
+	}
+
 	{
 		CAGE_TESTCASE("periodic interrupt");
 		constexpr const char source[] = R"asm(
@@ -1,4 +1,5 @@
 #include <cage-core/math.h>
+#include <cage-core/ini.h>
 
 #include "main.h"
 
@@ -313,6 +314,130 @@ call Bottomless
 		}
 	}
 
+	{
+		CAGE_TESTCASE("calls nested deeper than callstack capacity");
+		constexpr const char source[] = R"asm(
+call First
+function First
+call Second
+return
+function Second
+set A 42
+copy z B
+condcall Third
+return
+function Third
+return
+)asm";
+		Holder<Program> program = newCompiler()->compile(source);
+		CpuCreateConfig cfg;
+		cfg.limits.callstackCapacity = 2;
+		Holder<Cpu> cpu = newCpu(cfg);
+		{
+			CAGE_TESTCASE("path within capacity");
+			cpu->program(+program);
+			cpu->run();
+			CAGE_TEST(cpu->state() == CpuStateEnum::Finished);
+			CAGE_TEST(cpu->registers()[0] == 42);
+			CAGE_TEST(cpu->callstack().empty());
+		}
+		{
+			CAGE_TESTCASE("path exceeding capacity");
+			cpu->program(+program);
+			uint32 rs[26] = {};
+			rs[1] = 1;
+			cpu->registers(rs);
+			CAGE_TEST_THROWN(cpu->run());
+			CAGE_TEST(cpu->state() == CpuStateEnum::Terminated);
+			CAGE_TEST(cpu->callstack().size() == 2);
+		}
+	}
+
+	{
+		CAGE_TESTCASE("disabled instructions");
+		constexpr const char source[] = R"asm(
+set A 4
+set B 5
+copy z C
+condjmp Skip
+add D A B
+label Skip
+rand E
+)asm";
+		CpuCreateConfig cfg;
+		cfg.limits.disabledInstructions = { "add", "random" };
+		Holder<Cpu> cpu = newCpu(cfg);
+		{
+			CAGE_TESTCASE("instruction");
+			Holder<Program> program = newCompiler()->compile(source);
+			cpu->program(+program);
+			CAGE_TEST_THROWN(cpu->run());
+			CAGE_TEST(cpu->state() == CpuStateEnum::Terminated);
+			CAGE_TEST(cpu->sourceLine() == 5);
+			CAGE_TEST(cpu->stepIndex() == 5);
+		}
+		{
+			CAGE_TESTCASE("category");
+			Holder<Program> program = newCompiler()->compile(source);
+			cpu->program(+program);
+			uint32 rs[26] = {};
+			rs[2] = 1;
+			cpu->registers(rs);
+			CAGE_TEST_THROWN(cpu->run());
+			CAGE_TEST(cpu->sourceLine() == 7);
+			CAGE_TEST(cpu->stepIndex() == 5);
+		}
+		{
+			CAGE_TESTCASE("disabled when compiling");
+			CompilerCreateConfig config;
+			config.constantPropagation = true;
+			config.deadCodeElimination = true;
+			config.disabledInstructions = cfg.limits.disabledInstructions;
+			Holder<Program> program = newCompiler(config)->compile(source);
+			Holder<Cpu> cpu = newCpu({});
+			cpu->program(+program);
+			CAGE_TEST_THROWN(cpu->run());
+			CAGE_TEST(cpu->sourceLine() == 5);
+			CAGE_TEST(cpu->stepIndex() == 5);
+		}
+		{
+			CAGE_TESTCASE("program without disabled instructions");
+			constexpr const char source[] = R"asm(
+set A 4
+inc A
+)asm";
+			Holder<Program> program = newCompiler()->compile(source);
+			cpu->program(+program);
+			cpu->run();
+			CAGE_TEST(cpu->state() == CpuStateEnum::Finished);
+			CAGE_TEST(cpu->registers()[0] == 5);
+		}
+		{
+			CAGE_TESTCASE("unknown name");
+			CpuCreateConfig cfg;
+			cfg.limits.disabledInstructions = { "addd" };
+			Holder<Cpu> cpu = newCpu(cfg);
+			Holder<Program> program = newCompiler()->compile(source);
+			CAGE_TEST_THROWN(cpu->program(+program));
+			CompilerCreateConfig config;
+			config.disabledInstructions = cfg.limits.disabledInstructions;
+			CAGE_TEST_THROWN(newCompiler(config)->compile(source));
+		}
+		{
+			CAGE_TESTCASE("limits in ini");
+			Holder<Ini> ini = newIni();
+			limitsToIni(cfg.limits, +ini);
+			ini->setBool("disabled", "add", false);
+			ini->setBool("disabled", "fsqrt", true);
+			const CpuLimitsConfig limits = limitsFromIni(+ini, cfg.limits);
+			CAGE_TEST(limits.disabledInstructions.size() == 2);
+			CAGE_TEST(limits.disabledInstructions[0] == "random");
+			CAGE_TEST(limits.disabledInstructions[1] == "fsqrt");
+			ini->setBool("disabled", "addd", true);
+			CAGE_TEST_THROWN(limitsFromIni(+ini));
+		}
+	}
+
 	{
 		CAGE_TESTCASE("labels are scoped within function");
 		constexpr const char source[] = R"asm(
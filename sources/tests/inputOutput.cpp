@@ -34,6 +34,26 @@ namespace
 		}
 	};
 
+	struct BinaryStream
+	{
+		std::vector<uint32> data;
+		uint32 position = 0;
+
+		uint32 read(PointerRange<uint32> values)
+		{
+			uint32 cnt = 0;
+			while (cnt < values.size() && position < data.size())
+				values[cnt++] = data[position++];
+			return cnt;
+		}
+
+		bool write(PointerRange<const uint32> values)
+		{
+			data.insert(data.end(), values.begin(), values.end());
+			return true;
+		}
+	};
+
 	uint32 countLines(PointerRange<const char> str)
 	{
 		Holder<LineReader> reader = newLineReader(str);
@@ -159,6 +179,37 @@ label End
 		output.test(expected);
 	}
 
+	{
+		CAGE_TESTCASE("filtering input");
+		constexpr const char source[] = R"asm(
+readln
+copy A f
+rwswap
+writeln
+readln
+copy B f
+rwswap
+writeln
+)asm";
+		constexpr const char input[] = "some $invalid {characters} in\tthis [long] line\nall characters in this line are (valid) = 42!\n";
+		constexpr const char expected[] = R"text(some invalid characters inthis long line
+all characters in this line are (valid) = 42!
+)text";
+		Holder<Program> program = newCompiler()->compile(source);
+		Holder<LineReader> reader = newLineReader(input);
+		Output output;
+		CpuCreateConfig cfg;
+		cfg.input = Delegate<bool(string &)>().bind<LineReader, &LineReader::readLine>(+reader);
+		cfg.output = Delegate<bool(const string &)>().bind<Output, &Output::writeln>(&output);
+		Holder<Cpu> cpu = newCpu(cfg);
+		cpu->program(+program);
+		cpu->run();
+		CAGE_TEST(cpu->state() == CpuStateEnum::Finished);
+		output.test(expected);
+		CAGE_TEST(cpu->registers()[0] == 0);
+		CAGE_TEST(cpu->registers()[1] == 1);
+	}
+
 	{
 		CAGE_TESTCASE("reading beyond line end");
 		constexpr const char source[] = R"asm(
@@ -177,6 +228,195 @@ jump Start
 		CAGE_TEST_THROWN(cpu->run());
 	}
 
+	{
+		CAGE_TESTCASE("stat writes only registers that are read");
+		constexpr const char source[] = R"asm(
+readln
+rstat
+copy A u
+set i 3
+set s 4
+stat TA
+copy B c
+rstat
+)asm";
+		Holder<Program> program = newCompiler()->compile(source);
+		Holder<LineReader> reader = newLineReader("12\n");
+		CpuCreateConfig cfg;
+		cfg.input = Delegate<bool(string &)>().bind<LineReader, &LineReader::readLine>(+reader);
+		cfg.interruptPeriod = 3; // after the first rstat
+		Holder<Cpu> cpu = newCpu(cfg);
+		cpu->program(+program);
+		cpu->run();
+		CAGE_TEST(cpu->state() == CpuStateEnum::Interrupted);
+		const auto ir = cpu->implicitRegisters();
+		CAGE_TEST(ir['u' - 'a'] == 1);
+		CAGE_TEST(ir['i' - 'a'] == 0); // overwritten before read, skipped
+		CAGE_TEST(ir['s' - 'a'] == 0);
+		CAGE_TEST(ir['c' - 'a'] == 0); // overwritten by the stat before read
+		while (cpu->state() == CpuStateEnum::Interrupted)
+			cpu->run();
+		CAGE_TEST(cpu->state() == CpuStateEnum::Finished);
+		CAGE_TEST(cpu->registers()[0] == 1);
+		CAGE_TEST(cpu->registers()[1] == CpuLimitsConfig().tapeCapacity);
+		// the program ends after the last rstat, all registers are written
+		CAGE_TEST(ir['i' - 'a'] == 1);
+		CAGE_TEST(ir['f' - 'a'] == 1);
+		CAGE_TEST(ir['s' - 'a'] == 2);
+		CAGE_TEST(ir['e' - 'a'] == 1);
+		{
+			CAGE_TESTCASE("single steps write all registers");
+			reader = newLineReader("12\n");
+			cfg.input = Delegate<bool(string &)>().bind<LineReader, &LineReader::readLine>(+reader);
+			cfg.interruptPeriod = m;
+			Holder<Cpu> cpu = newCpu(cfg);
+			cpu->program(+program);
+			cpu->step();
+			cpu->step();
+			const auto ir = cpu->implicitRegisters();
+			CAGE_TEST(ir['u' - 'a'] == 1);
+			CAGE_TEST(ir['i' - 'a'] == 1);
+			CAGE_TEST(ir['s' - 'a'] == 2);
+			CAGE_TEST(ir['c' - 'a'] == 1);
+		}
+	}
+
+	{
+		CAGE_TESTCASE("bulk read and write");
+		constexpr const char source[] = R"asm(
+readln
+readall MA
+copy N n
+readlns QA
+add N N n
+copy i N
+dequeue A QA
+store MA@3 A
+set i 1
+set n 3
+writeall MA
+iset A -3
+store MA@0 A
+set i 0
+set n 2
+iwriteall MA
+)asm";
+		constexpr const char input[] = R"text(1 2  3
+4
+5 6
+)text";
+		constexpr const char expected[] = R"text(2 3 4
+-3 2
+)text";
+		Holder<Program> program = newCompiler()->compile(source);
+		Holder<LineReader> reader = newLineReader(input);
+		Output output;
+		CpuCreateConfig cfg;
+		cfg.input = Delegate<bool(string &)>().bind<LineReader, &LineReader::readLine>(+reader);
+		cfg.output = Delegate<bool(const string &)>().bind<Output, &Output::writeln>(&output);
+		Holder<Cpu> cpu = newCpu(cfg);
+		cpu->program(+program);
+		CAGE_TEST(cpu->state() == CpuStateEnum::Initialized);
+		cpu->run();
+		CAGE_TEST(cpu->state() == CpuStateEnum::Finished);
+		output.test(expected);
+		CAGE_TEST(cpu->registers()['N' - 'A'] == 6);
+		CAGE_TEST(cpu->queue(0).size() == 2);
+		CAGE_TEST(cpu->stepIndex() == 17 + 3 + 3 + 3 + 2);
+	}
+
+	{
+		CAGE_TESTCASE("binary input and output");
+		constexpr const char source[] = R"asm(
+bread A
+bread B
+add C A B
+bwrite C
+set i 10
+set n 5
+bread MA
+copy N n
+bwrite MA
+bread D
+)asm";
+		Holder<Program> program = newCompiler()->compile(source);
+		BinaryStream input, output;
+		input.data = { 42, 13, 1, 2, 3 };
+		CpuCreateConfig cfg;
+		cfg.binaryInput = Delegate<uint32(PointerRange<uint32>)>().bind<BinaryStream, &BinaryStream::read>(&input);
+		cfg.binaryOutput = Delegate<bool(PointerRange<const uint32>)>().bind<BinaryStream, &BinaryStream::write>(&output);
+		Holder<Cpu> cpu = newCpu(cfg);
+		cpu->program(+program);
+		CAGE_TEST(cpu->state() == CpuStateEnum::Initialized);
+		cpu->run();
+		CAGE_TEST(cpu->state() == CpuStateEnum::Finished);
+		CAGE_TEST(cpu->registers()['N' - 'A'] == 3);
+		CAGE_TEST(cpu->implicitRegisters()['z' - 'a'] == 0);
+		CAGE_TEST(cpu->memory(0)[12] == 3);
+		CAGE_TEST((output.data == std::vector<uint32>{ 55, 1, 2, 3 }));
+	}
+
+	{
+		CAGE_TESTCASE("memory io");
+		constexpr const char source[] = R"asm(
+label Start
+readln
+inv z
+condjmp End
+read A
+inc A
+write A
+writeln
+jump Start
+label End
+)asm";
+		constexpr const char input[] = "1\n2\r\n3\n4";
+		Holder<Program> program = newCompiler()->compile(source);
+		Holder<MemoryIo> io = newMemoryIo();
+		io->input(input);
+		CpuCreateConfig cfg;
+		io->bind(cfg);
+		Holder<Cpu> cpu = newCpu(cfg);
+
+		{
+			CAGE_TESTCASE("matching output");
+			constexpr const char expected[] = "2\n3\n4\n5\n";
+			io->expectedOutput(expected);
+			cpu->program(+program);
+			cpu->run();
+			CAGE_TEST(cpu->state() == CpuStateEnum::Finished);
+			CAGE_TEST(io->output().size() == sizeof(expected) - 1);
+			CAGE_TEST(detail::memcmp(io->output().data(), expected, sizeof(expected) - 1) == 0);
+			CAGE_TEST(io->mismatchLine() == m);
+			CAGE_TEST(io->outputMatches());
+		}
+
+		{
+			CAGE_TESTCASE("missing output");
+			constexpr const char expected[] = "2\n3\n4\n5\n6\n";
+			io->reset();
+			io->expectedOutput(expected);
+			cpu->reinitialize();
+			cpu->run();
+			CAGE_TEST(cpu->state() == CpuStateEnum::Finished);
+			CAGE_TEST(io->mismatchLine() == m);
+			CAGE_TEST(!io->outputMatches());
+		}
+
+		{
+			CAGE_TESTCASE("interrupt on mismatch");
+			constexpr const char expected[] = "2\n7\n4\n5\n";
+			io->reset();
+			io->expectedOutput(expected, +cpu);
+			cpu->reinitialize();
+			cpu->run();
+			CAGE_TEST(cpu->state() == CpuStateEnum::Interrupted);
+			CAGE_TEST(io->mismatchLine() == 1);
+			CAGE_TEST(!io->outputMatches());
+			CAGE_TEST(io->output().size() == 4);
+		}
+	}
+
 	{
 		CAGE_TESTCASE("random numbers");
 		Output numbers;
@@ -10,6 +10,8 @@ void testStructures();
 void testFlow();
 void testInputOutput();
 void testDebugging();
+void testOptimizations();
+void testAnalysis();
 
 int main()
 {
@@ -23,6 +25,8 @@ int main()
 	testFlow();
 	testInputOutput();
 	testDebugging();
+	testOptimizations();
+	testAnalysis();
 
 	{
 		CAGE_TESTCASE("all tests done ok");
@@ -0,0 +1,429 @@
+#include <cage-core/math.h>
+
+#include "main.h"
+
+namespace
+{
+	struct Run
+	{
+		Holder<Program> program;
+		Holder<Cpu> cpu;
+		bool thrown = false;
+	};
+
+	Run run(const CompilerCreateConfig &config, PointerRange<const char> source)
+	{
+		Run r;
+		r.program = newCompiler(config)->compile(source);
+		r.cpu = newCpu({});
+		r.cpu->program(+r.program);
+		try
+		{
+			r.cpu->run();
+		}
+		catch (...)
+		{
+			r.thrown = true;
+		}
+		return r;
+	}
+
+	bool equal(PointerRange<const uint32> a, PointerRange<const uint32> b)
+	{
+		if (a.size() != b.size())
+			return false;
+		for (uint32 i = 0; i < a.size(); i++)
+			if (a[i] != b[i])
+				return false;
+		return true;
+	}
+
+	// runs the program with and without the optimizations and compares the results
+	void compare(const CompilerCreateConfig &config, PointerRange<const char> source)
+	{
+		const Run a = run({}, source);
+		const Run b = run(config, source);
+		CAGE_TEST(a.thrown == b.thrown);
+		CAGE_TEST(a.cpu->state() == b.cpu->state());
+		CAGE_TEST(equal(a.cpu->registers(), b.cpu->registers()));
+		CAGE_TEST(equal(a.cpu->implicitRegisters(), b.cpu->implicitRegisters()));
+		CAGE_TEST(a.cpu->stepIndex() == b.cpu->stepIndex());
+		CAGE_TEST(a.cpu->sourceLine() == b.cpu->sourceLine());
+		CAGE_TEST(a.cpu->functionIndex() == b.cpu->functionIndex());
+	}
+}
+
+void testOptimizations()
+{
+	CAGE_TESTCASE("optimizations");
+
+	{
+		CAGE_TESTCASE("constant propagation");
+		CompilerCreateConfig config;
+		config.constantPropagation = true;
+
+		{
+			CAGE_TESTCASE("loop with constant bound");
+			constexpr const char source[] = R"asm(
+set T 1000
+label Loop
+inc I
+add S S I
+lt z I T
+condjmp Loop
+)asm";
+			compare(config, source);
+			Run r = run(config, source);
+			CAGE_TEST(r.cpu->registers()[8] == 1000);
+			CAGE_TEST(r.cpu->registers()[18] == 500500);
+		}
+
+		{
+			CAGE_TESTCASE("folding");
+			constexpr const char source[] = R"asm(
+set A 5
+add B A A
+mul C B A
+lt z A C
+condset D 7
+gt z A C
+condset E 9
+iset F -3
+imul G F A
+fset H 1.5
+fmul I H H
+copy J G
+)asm";
+			compare(config, source);
+			Run r = run(config, source);
+			CAGE_TEST(r.cpu->registers()[1] == 10);
+			CAGE_TEST(r.cpu->registers()[2] == 50);
+			CAGE_TEST(r.cpu->registers()[3] == 7);
+			CAGE_TEST(r.cpu->registers()[4] == 0);
+			CAGE_TEST(r.cpu->registers()[9] == uint32(-15));
+		}
+
+		{
+			CAGE_TESTCASE("values from different paths");
+			constexpr const char source[] = R"asm(
+set A 1
+set T 2
+set N 5
+label Loop
+inc I
+mod z I T
+condjmp Odd
+set C 10
+jump Join
+label Odd
+set C 20
+label Join
+add D D C
+add D D A
+lt z I N
+condjmp Loop
+)asm";
+			compare(config, source);
+			Run r = run(config, source);
+			CAGE_TEST(r.cpu->registers()[3] == 85);
+		}
+
+		{
+			CAGE_TESTCASE("function calls invalidate registers");
+			constexpr const char source[] = R"asm(
+set A 1
+call Modify
+add B A A
+set C 3
+call Keep
+add D C C
+
+function Modify
+set A 2
+return
+
+function Keep
+add E C C
+return
+)asm";
+			compare(config, source);
+			Run r = run(config, source);
+			CAGE_TEST(r.cpu->registers()[1] == 4);
+			CAGE_TEST(r.cpu->registers()[3] == 6);
+			CAGE_TEST(r.cpu->registers()[4] == 6);
+		}
+
+		{
+			CAGE_TESTCASE("indirect copy invalidates registers");
+			constexpr const char source[] = R"asm(
+set A 1
+set B 2
+set d 0
+set s 1
+indcpy
+add C A A
+)asm";
+			compare(config, source);
+			Run r = run(config, source);
+			CAGE_TEST(r.cpu->registers()[2] == 4);
+		}
+
+		{
+			CAGE_TESTCASE("division by zero is not folded");
+			constexpr const char source[] = R"asm(
+set A 5
+set B 0
+set C 1
+div C A B
+)asm";
+			compare(config, source);
+			Run r = run(config, source);
+			CAGE_TEST(r.thrown);
+			CAGE_TEST(r.cpu->state() == CpuStateEnum::Terminated);
+			CAGE_TEST(r.cpu->sourceLine() == 4);
+			CAGE_TEST(r.cpu->registers()[2] == 1);
+		}
+	}
+
+	{
+		CAGE_TESTCASE("dead code elimination");
+		CompilerCreateConfig config;
+		config.deadCodeElimination = true;
+
+		{
+			CAGE_TESTCASE("unused function and code after jump");
+			constexpr const char source[] = R"asm(
+set A 1
+jump Skip
+set A 2
+set B 3
+label Skip
+call Used
+inc A
+
+function Unused
+set C 4
+set D 5
+return
+
+function Used
+set C 6
+return
+)asm";
+			compare(config, source);
+			const Run a = run({}, source);
+			const Run b = run(config, source);
+			CAGE_TEST(b.program->instructionsCount() + 6 <= a.program->instructionsCount());
+			CAGE_TEST(b.cpu->registers()[0] == 2);
+			CAGE_TEST(b.cpu->registers()[2] == 6);
+		}
+
+		{
+			CAGE_TESTCASE("errors report original location");
+			constexpr const char source[] = R"asm(
+call Divide
+set A 1
+
+function Unused
+set A 2
+return
+
+function Divide
+set B 0
+div C C B
+return
+)asm";
+			compare(config, source);
+			const Run r = run(config, source);
+			CAGE_TEST(r.thrown);
+			CAGE_TEST(r.cpu->sourceLine() == 10);
+			CAGE_TEST(r.program->functionName(r.cpu->functionIndex()) == "Divide");
+		}
+
+		{
+			CAGE_TESTCASE("combined with constant propagation");
+			config.constantPropagation = true;
+			constexpr const char source[] = R"asm(
+set A 1
+set B 2
+lt z A B
+condjmp Done
+set C 3
+call Never
+label Done
+set D 4
+
+function Never
+set E 5
+return
+)asm";
+			compare(config, source);
+			const Run a = run({}, source);
+			const Run b = run(config, source);
+			CAGE_TEST(b.program->instructionsCount() + 4 <= a.program->instructionsCount());
+		}
+	}
+
+	{
+		CAGE_TESTCASE("jump threading");
+		CompilerCreateConfig config;
+		config.jumpThreading = true;
+
+		{
+			CAGE_TESTCASE("chain of jumps");
+			constexpr const char source[] = R"asm(
+set N 10
+label Loop
+inc I
+lt z I N
+condjmp First
+jump Done
+label First
+jump Second
+label Second
+jump Third
+label Third
+add S S I
+jump Loop
+label Done
+)asm";
+			compare(config, source);
+			const Run r = run(config, source);
+			CAGE_TEST(r.cpu->registers()[18] == 45);
+		}
+
+		{
+			CAGE_TESTCASE("code placed after jumps");
+			constexpr const char source[] = R"asm(
+set A 1
+jump Middle
+label End
+set C 3
+jump Finish
+label Middle
+set B 2
+jump End
+label Finish
+div D A Z
+)asm";
+			compare(config, source);
+			const Run a = run({}, source);
+			const Run b = run(config, source);
+			CAGE_TEST(b.program->instructionsCount() < a.program->instructionsCount());
+			CAGE_TEST(b.thrown);
+			CAGE_TEST(b.cpu->sourceLine() == 10);
+			CAGE_TEST(b.cpu->registers()[2] == 3);
+		}
+
+		{
+			CAGE_TESTCASE("all optimizations");
+			config.constantPropagation = true;
+			config.deadCodeElimination = true;
+			constexpr const char source[] = R"asm(
+set N 5
+label Loop
+call Increment
+lt z I N
+condjmp Again
+jump Done
+label Again
+jump Loop
+label Done
+jump Exit
+label Exit
+
+function Increment
+jump Inc
+label Inc
+inc I
+return
+)asm";
+			compare(config, source);
+			const Run r = run(config, source);
+			CAGE_TEST(r.cpu->registers()[8] == 5);
+		}
+
+		{
+			CAGE_TESTCASE("infinite loop of jumps");
+			constexpr const char source[] = R"asm(
+set A 1
+jump Second
+label First
+jump Second
+label Second
+jump First
+)asm";
+			Holder<Program> program = newCompiler(config)->compile(source);
+			CpuCreateConfig cfg;
+			cfg.interruptPeriod = 100;
+			Holder<Cpu> cpu = newCpu(cfg);
+			cpu->program(+program);
+			cpu->run();
+			CAGE_TEST(cpu->state() == CpuStateEnum::Interrupted);
+			CAGE_TEST(cpu->registers()[0] == 1);
+		}
+	}
+
+	{
+		CAGE_TESTCASE("inlining");
+		CompilerCreateConfig config;
+		config.inlining = true;
+
+		constexpr const char source[] = R"asm(
+set W 4
+label Loop
+call Sum
+inc X
+lt z X W
+condjmp Loop
+call Check
+
+function Sum
+add S S X
+lt z S W
+condreturn
+inc T
+return
+
+function Check
+set D 0
+div E S D
+return
+)asm";
+
+		{
+			CAGE_TESTCASE("same results");
+			compare(config, source);
+			config.constantPropagation = true;
+			config.deadCodeElimination = true;
+			config.jumpThreading = true;
+			compare(config, source);
+		}
+
+		{
+			CAGE_TESTCASE("function names of inlined code");
+			const Run r = run(config, source);
+			CAGE_TEST(r.thrown);
+			CAGE_TEST(r.program->functionName(r.cpu->functionIndex()) == "Check");
+			CAGE_TEST(r.cpu->sourceLine() == 18);
+			CAGE_TEST(r.cpu->callstack().empty());
+			CAGE_TEST(r.cpu->registers()[18] == 6);
+			CAGE_TEST(r.cpu->registers()[19] == 1);
+		}
+
+		{
+			CAGE_TESTCASE("recursive functions are not inlined");
+			constexpr const char source[] = R"asm(
+set N 5
+call Recursive
+
+function Recursive
+dec N
+neq z N Z
+condcall Recursive
+return
+)asm";
+			compare(config, source);
+		}
+	}
+}
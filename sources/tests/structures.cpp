@@ -88,4 +88,275 @@ load M MA@13
 		cpu->program(nullptr);
 		CAGE_TEST(cpu->state() == CpuStateEnum::None);
 	}
-}
+	{
+		CAGE_TESTCASE("memory limits");
+		CpuCreateConfig cfg;
+		cfg.limits.memoryCapacity[0] = 10;
+		cfg.limits.memoryReadOnly[1] = true;
+		cfg.limits.memoriesCount = 3;
+		Holder<Cpu> cpu = newCpu(cfg);
+		{
+			CAGE_TESTCASE("constant addresses");
+			constexpr const char source[] = R"asm(
+set A 5
+store MA@9 A
+store MC@9 A
+load B MA@9
+load C MB@9
+load D MC@9
+)asm";
+			Holder<Program> program = newCompiler()->compile(source);
+			cpu->program(+program);
+			cpu->run();
+			CAGE_TEST(cpu->state() == CpuStateEnum::Finished);
+			CAGE_TEST(cpu->registers()[1] == 5);
+			CAGE_TEST(cpu->registers()[2] == 0);
+			CAGE_TEST(cpu->registers()[3] == 5);
+		}
+		{
+			CAGE_TESTCASE("out of bounds");
+			constexpr const char source[] = R"asm(
+set A 5
+store MA@10 A
+)asm";
+			Holder<Program> program = newCompiler()->compile(source);
+			cpu->program(+program); // loads with a warning
+			CAGE_TEST_THROWN(cpu->run());
+			CAGE_TEST(cpu->sourceLine() == 2);
+		}
+		{
+			CAGE_TESTCASE("disabled pool");
+			constexpr const char source[] = R"asm(
+load A MD@0
+)asm";
+			Holder<Program> program = newCompiler()->compile(source);
+			cpu->program(+program);
+			CAGE_TEST_THROWN(cpu->run());
+		}
+		{
+			CAGE_TESTCASE("read only pool");
+			constexpr const char source[] = R"asm(
+set A 5
+store MB@3 A
+)asm";
+			Holder<Program> program = newCompiler()->compile(source);
+			cpu->program(+program);
+			CAGE_TEST_THROWN(cpu->run());
+			CAGE_TEST(cpu->sourceLine() == 2);
+			CAGE_TEST(cpu->memory(1)[3] == 0);
+		}
+		{
+			CAGE_TESTCASE("read only pool with indirect store");
+			constexpr const char source[] = R"asm(
+set A 5
+set i 3
+indstore MB A
+)asm";
+			Holder<Program> program = newCompiler()->compile(source);
+			cpu->program(+program);
+			CAGE_TEST_THROWN(cpu->run());
+			CAGE_TEST(cpu->memory(1)[3] == 0);
+		}
+		{
+			CAGE_TESTCASE("swapped pools");
+			constexpr const char source[] = R"asm(
+set A 5
+swap MA MC
+store MA@20 A
+load B MA@20
+)asm";
+			Holder<Program> program = newCompiler()->compile(source);
+			cpu->program(+program);
+			cpu->run();
+			CAGE_TEST(cpu->state() == CpuStateEnum::Finished);
+			CAGE_TEST(cpu->registers()[1] == 5);
+			CAGE_TEST(cpu->memory(0)[20] == 5);
+			CAGE_TEST(cpu->memory(2).size() == 10);
+		}
+		{
+			CAGE_TESTCASE("indexed accesses in counted loops");
+			constexpr const char source[] = R"asm(
+set C 10
+set I 0
+label Fill
+copy i I
+inc I
+indstore MA I
+lt z I C
+condjmp Fill
+call Sum
+copy A S
+set C 9
+call Last
+copy B L
+copy C D
+call Last
+set P 5
+set C 10
+call Sum
+
+function Sum
+set S 0
+set I 0
+label Loop
+add i P I
+indload V MA
+add S S V
+inc I
+lt z I C
+condjmp Loop
+return
+
+function Last
+set I 0
+label Loop
+inc I
+add i P I
+indload L MA
+lt z I C
+condjmp Loop
+return
+)asm";
+			Holder<Program> program = newCompiler()->compile(source);
+			cpu->program(+program);
+			uint32 rs[26] = {};
+			rs['D' - 'A'] = 10;
+			cpu->registers(rs);
+			CAGE_TEST_THROWN(cpu->run());
+			CAGE_TEST(cpu->registers()[0] == 55);
+			CAGE_TEST(cpu->registers()[1] == 10);
+			CAGE_TEST(cpu->registers()['I' - 'A'] == 10);
+			CAGE_TEST(cpu->sourceLine() == 37);
+			CAGE_TEST(cpu->stepIndex() == 218); // same as without the hoisted checks
+			cpu->reinitialize();
+			rs['D' - 'A'] = 9;
+			cpu->registers(rs);
+			CAGE_TEST_THROWN(cpu->run());
+			CAGE_TEST(cpu->registers()['I' - 'A'] == 5);
+			CAGE_TEST(cpu->registers()['S' - 'A'] == 6 + 7 + 8 + 9 + 10);
+			CAGE_TEST(cpu->sourceLine() == 25);
+			CAGE_TEST(cpu->stepIndex() == 253);
+		}
+		{
+			CAGE_TESTCASE("fill, copy and sum loops");
+			constexpr const char source[] = R"asm(
+set F 7
+set C 10
+set I 0
+label Fill
+copy i I
+indstore MC F
+inc I
+lt z I C
+condjmp Fill
+set P 5
+set T 2
+set I 0
+label Copy
+add i I T
+indload V MC
+add i P I
+indstore MA V
+inc I
+lt z I D
+condjmp Copy
+set S 1
+set I 0
+label Sum
+add i P I
+indload V MA
+add S S V
+inc I
+lt z I D
+condjmp Sum
+)asm";
+			Holder<Program> program = newCompiler()->compile(source);
+			cpu->program(+program);
+			uint32 rs[26] = {};
+			rs['D' - 'A'] = 5;
+			cpu->registers(rs);
+			cpu->run();
+			CAGE_TEST(cpu->state() == CpuStateEnum::Finished);
+			CAGE_TEST(cpu->registers()['S' - 'A'] == 36);
+			CAGE_TEST(cpu->registers()['V' - 'A'] == 7);
+			CAGE_TEST(cpu->registers()['I' - 'A'] == 5);
+			CAGE_TEST(cpu->implicitRegisters()['i' - 'a'] == 9);
+			CAGE_TEST(cpu->implicitRegisters()['z' - 'a'] == 0);
+			CAGE_TEST(cpu->memory(2)[9] == 7);
+			CAGE_TEST(cpu->memory(0)[9] == 7);
+			CAGE_TEST(cpu->stepIndex() == 124); // same as executing the individual instructions
+			cpu->reinitialize();
+			rs['D' - 'A'] = 6;
+			cpu->registers(rs);
+			CAGE_TEST_THROWN(cpu->run()); // the copy exceeds the pool, fails in the last iteration
+			CAGE_TEST(cpu->registers()['I' - 'A'] == 5);
+			CAGE_TEST(cpu->memory(0)[9] == 7);
+			CAGE_TEST(cpu->sourceLine() == 17);
+			CAGE_TEST(cpu->stepIndex() == 95);
+		}
+		{
+			CAGE_TESTCASE("pools not used by the program");
+			constexpr const char source[] = R"asm(
+set A 5
+store MA@3 A
+set i 2
+indstat MA
+)asm";
+			Holder<Program> program = newCompiler()->compile(source);
+			cpu->program(+program);
+			cpu->run();
+			CAGE_TEST(cpu->state() == CpuStateEnum::Finished);
+			const auto ir = cpu->implicitRegisters();
+			CAGE_TEST(ir['e' - 'a'] == 1);
+			CAGE_TEST(ir['c' - 'a'] == CpuLimitsConfig().memoryCapacity[2]);
+			CAGE_TEST(ir['s' - 'a'] == CpuLimitsConfig().memoryCapacity[2]);
+			CAGE_TEST(cpu->memory(2).size() == CpuLimitsConfig().memoryCapacity[2]);
+			CAGE_TEST(cpu->memory(2)[42] == 0);
+			cpu->reinitialize();
+			const uint32 data[3] = { 1, 2, 3 };
+			cpu->memory(2, data);
+			CAGE_TEST(cpu->memory(2)[1] == 2);
+			CAGE_TEST(cpu->memory(0)[3] == 0);
+		}
+		{
+			CAGE_TESTCASE("memory data");
+			constexpr const char source[] = R"asm(
+data MB@2 10 20 30
+idata MA@8 -1 -2
+load A MB@3
+set i 4
+indload B MB
+function Unused
+fdata MC@0 1.5
+data MA@9 7
+return
+)asm";
+			Holder<Program> program = newCompiler()->compile(source);
+			cpu->program(+program);
+			CAGE_TEST(cpu->memory(1)[2] == 10);
+			CAGE_TEST(cpu->memory(0)[8] == (uint32)-1);
+			CAGE_TEST(cpu->memory(0)[9] == 7); // later data overwrite earlier ones
+			CAGE_TEST(cpu->memory(2)[0] == 0x3FC00000); // 1.5f
+			cpu->run();
+			CAGE_TEST(cpu->state() == CpuStateEnum::Finished);
+			CAGE_TEST(cpu->registers()[0] == 20);
+			CAGE_TEST(cpu->registers()[1] == 30);
+			cpu->reinitialize();
+			CAGE_TEST(cpu->memory(1)[4] == 30);
+			Holder<Program> loaded = newProgram(program->exportBuffer(false));
+			cpu->program(+loaded);
+			CAGE_TEST(cpu->memory(0)[8] == (uint32)-1);
+			CAGE_TEST(cpu->memory(0)[9] == 7);
+		}
+		{
+			CAGE_TESTCASE("invalid memory data");
+			CAGE_TEST_THROWN(cpu->program(+newCompiler()->compile("data MA@8 1 2 3\n"))); // exceeds capacity
+			CAGE_TEST_THROWN(cpu->program(+newCompiler()->compile("data MD@0 1\n"))); // disabled pool
+			CAGE_TEST_THROWN(newCompiler()->compile("data SA 1\n"));
+			CAGE_TEST_THROWN(newCompiler()->compile("data MA@3\n"));
+			CAGE_TEST_THROWN(newCompiler()->compile("data MA@4294967295 1 2\n"));
+			cpu->program(+newCompiler()->compile("data MA@7 1 2 3\n"));
+			CAGE_TEST(cpu->memory(0)[9] == 3);
+		}
+	}
+}
\ No newline at end of file